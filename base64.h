@@ -24,8 +24,17 @@
 #define SRC_BASE64_H_
 
 #include <stddef.h>
+#include <stdint.h>
 #include <cassert>
 
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define BASE64_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define BASE64_HAVE_X86_SIMD 0
+#endif
+
 
 //// Base 64 ////
 #define base64_encoded_size(size) ((size + 2 - ((size + 2) % 3)) / 3 * 4)
@@ -70,6 +79,255 @@ extern const int8_t unbase64_table[256];
   static_cast<uint8_t>(unbase64_table[static_cast<uint8_t>(x)])
 
 
+//// SIMD kernels ////
+// The kernels below only handle the bulk of the input: whole blocks that
+// contain nothing but legal base64 characters.  They advance *i (source
+// position) and *k (destination position) and leave everything else -
+// padding, whitespace, invalid input and the tail - to the scalar code, which
+// stays the reference implementation.
+
+enum base64_simd_level {
+  kBase64SimdNone,
+  kBase64SimdSsse3,
+  kBase64SimdAvx2
+};
+
+static inline base64_simd_level base64_detect_simd_level() {
+#if BASE64_HAVE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return kBase64SimdAvx2;
+  if (__builtin_cpu_supports("ssse3"))
+    return kBase64SimdSsse3;
+#endif
+  return kBase64SimdNone;
+}
+
+static inline base64_simd_level base64_simd() {
+  static const base64_simd_level level = base64_detect_simd_level();
+  return level;
+}
+
+#if BASE64_HAVE_X86_SIMD
+
+// Splits 12 input bytes (per 128-bit lane) into 16 6-bit indices, one per
+// output byte.
+__attribute__((target("ssse3")))
+static inline __m128i base64_enc_reshuffle_ssse3(__m128i in) {
+  in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4,
+                                          7, 6, 8, 7, 10, 9, 11, 10));
+  const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+  const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+  const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+  const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+  return _mm_or_si128(t1, t3);
+}
+
+// Maps 6-bit indices to the base64 alphabet.
+__attribute__((target("ssse3")))
+static inline __m128i base64_enc_translate_ssse3(__m128i in) {
+  // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12
+  __m128i index = _mm_subs_epu8(in, _mm_set1_epi8(51));
+  const __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), in);
+  index = _mm_or_si128(index, _mm_and_si128(less, _mm_set1_epi8(13)));
+  const __m128i shift = _mm_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+      '/' - 63, 'A', 0, 0);
+  return _mm_add_epi8(in, _mm_shuffle_epi8(shift, index));
+}
+
+__attribute__((target("ssse3")))
+static inline void base64_encode_ssse3(const char* src, size_t slen,
+                                       char* dst, size_t* i, size_t* k) {
+  // Each iteration loads 16 bytes and consumes 12 of them.
+  while (slen - *i >= 16) {
+    __m128i in =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + *i));
+    in = base64_enc_translate_ssse3(base64_enc_reshuffle_ssse3(in));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + *k), in);
+    *i += 12;
+    *k += 16;
+  }
+}
+
+__attribute__((target("avx2")))
+static inline void base64_encode_avx2(const char* src, size_t slen,
+                                      char* dst, size_t* i, size_t* k) {
+  // Each lane loads 16 bytes and consumes 12 of them.
+  while (slen - *i >= 28) {
+    const __m128i lo =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + *i));
+    const __m128i hi =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + *i + 12));
+    __m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    in = _mm256_or_si256(t1, t3);
+
+    __m256i index = _mm256_subs_epu8(in, _mm256_set1_epi8(51));
+    const __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), in);
+    index = _mm256_or_si256(index,
+                            _mm256_and_si256(less, _mm256_set1_epi8(13)));
+    const __m256i shift = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0);
+    in = _mm256_add_epi8(in, _mm256_shuffle_epi8(shift, index));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + *k), in);
+    *i += 24;
+    *k += 32;
+  }
+}
+
+// Returns false if any of the 16 characters is not in the base64 alphabet,
+// otherwise replaces *in with the 16 packed 6-bit values.
+__attribute__((target("ssse3")))
+static inline bool base64_dec_translate_ssse3(__m128i* in) {
+  const __m128i lut_lo = _mm_setr_epi8(
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m128i lut_hi = _mm_setr_epi8(
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_2f = _mm_set1_epi8(0x2f);
+  const __m128i hi_nibbles =
+      _mm_and_si128(_mm_srli_epi32(*in, 4), mask_2f);
+  const __m128i lo_nibbles = _mm_and_si128(*in, mask_2f);
+  const __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+  const __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+  const __m128i bad = _mm_and_si128(lo, hi);
+  if (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) != 0xFFFF)
+    return false;
+  const __m128i eq_2f = _mm_cmpeq_epi8(*in, mask_2f);
+  const __m128i roll =
+      _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi_nibbles));
+  *in = _mm_add_epi8(*in, roll);
+  return true;
+}
+
+__attribute__((target("ssse3")))
+static inline void base64_decode_ssse3(char* dst, size_t max_k,
+                                       const char* src, size_t max_i,
+                                       size_t* i, size_t* k) {
+  // Each iteration consumes 16 characters and stores 16 bytes, of which the
+  // first 12 are output.
+  while (max_i - *i >= 16 && max_k - *k >= 16) {
+    __m128i in =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + *i));
+    if (!base64_dec_translate_ssse3(&in))
+      return;
+    in = _mm_maddubs_epi16(in, _mm_set1_epi32(0x01400140));
+    in = _mm_madd_epi16(in, _mm_set1_epi32(0x00011000));
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                            14, 13, 12, -1, -1, -1, -1));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + *k), in);
+    *i += 16;
+    *k += 12;
+  }
+}
+
+__attribute__((target("avx2")))
+static inline void base64_decode_avx2(char* dst, size_t max_k,
+                                      const char* src, size_t max_i,
+                                      size_t* i, size_t* k) {
+  const __m256i lut_lo = _mm256_setr_epi8(
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+      0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m256i lut_hi = _mm256_setr_epi8(
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+      0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lut_roll = _mm256_setr_epi8(
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+      0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+  // Each iteration consumes 32 characters and stores 32 bytes, of which the
+  // first 24 are output.
+  while (max_i - *i >= 32 && max_k - *k >= 32) {
+    __m256i in =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + *i));
+    const __m256i hi_nibbles =
+        _mm256_and_si256(_mm256_srli_epi32(in, 4), mask_2f);
+    const __m256i lo_nibbles = _mm256_and_si256(in, mask_2f);
+    const __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+    const __m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+    if (!_mm256_testz_si256(lo, hi))
+      return;
+    const __m256i eq_2f = _mm256_cmpeq_epi8(in, mask_2f);
+    const __m256i roll =
+        _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi_nibbles));
+    in = _mm256_add_epi8(in, roll);
+    in = _mm256_maddubs_epi16(in, _mm256_set1_epi32(0x01400140));
+    in = _mm256_madd_epi16(in, _mm256_set1_epi32(0x00011000));
+    in = _mm256_shuffle_epi8(in, _mm256_setr_epi8(
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+        2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    in = _mm256_permutevar8x32_epi32(
+        in, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + *k), in);
+    *i += 32;
+    *k += 24;
+  }
+}
+
+#endif  // BASE64_HAVE_X86_SIMD
+
+// Encodes whole 3-byte groups of src[0..slen) starting at *i.
+static inline void base64_encode_simd(const char* src, size_t slen,
+                                      char* dst, size_t* i, size_t* k) {
+#if BASE64_HAVE_X86_SIMD
+  switch (base64_simd()) {
+    case kBase64SimdAvx2:
+      base64_encode_avx2(src, slen, dst, i, k);
+      // Fallthrough
+    case kBase64SimdSsse3:
+      base64_encode_ssse3(src, slen, dst, i, k);
+      break;
+    case kBase64SimdNone:
+      break;
+  }
+#endif
+}
+
+// Decodes whole blocks of legal characters of src[0..max_i) into
+// dst[0..max_k) starting at *i / *k, stopping at the first block that needs
+// the slow path.  Only single-byte sources are vectorized.
+template <typename TypeName>
+inline void base64_decode_simd(char* dst, size_t max_k,
+                               const TypeName* src, size_t max_i,
+                               size_t* i, size_t* k) {
+#if BASE64_HAVE_X86_SIMD
+  if (sizeof(TypeName) != 1)
+    return;
+  const char* bytes = reinterpret_cast<const char*>(src);
+  switch (base64_simd()) {
+    case kBase64SimdAvx2:
+      base64_decode_avx2(dst, max_k, bytes, max_i, i, k);
+      // Fallthrough
+    case kBase64SimdSsse3:
+      base64_decode_ssse3(dst, max_k, bytes, max_i, i, k);
+      break;
+    case kBase64SimdNone:
+      break;
+  }
+#endif
+}
+
+
 template <typename TypeName>
 bool base64_decode_group_slow(char* const dst, const size_t dstlen,
                               const TypeName* const src, const size_t srclen,
@@ -110,6 +368,7 @@ size_t base64_decode_fast(char* const dst, const size_t dstlen,
   size_t max_i = srclen / 4 * 4;
   size_t i = 0;
   size_t k = 0;
+  base64_decode_simd(dst, max_k, src, max_i, &i, &k);
   while (i < max_i && k < max_k) {
     const uint32_t v =
         unbase64(src[i + 0]) << 24 |
@@ -156,9 +415,9 @@ static size_t base64_encode(const char* src,
   unsigned a;
   unsigned b;
   unsigned c;
-  unsigned i;
-  unsigned k;
-  unsigned n;
+  size_t i;
+  size_t k;
+  size_t n;
 
   static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
                               "abcdefghijklmnopqrstuvwxyz"
@@ -168,6 +427,8 @@ static size_t base64_encode(const char* src,
   k = 0;
   n = slen / 3 * 3;
 
+  base64_encode_simd(src, slen, dst, &i, &k);
+
   while (i < n) {
     a = src[i + 0] & 0xff;
     b = src[i + 1] & 0xff;
@@ -206,4 +467,79 @@ static size_t base64_encode(const char* src,
   return dlen;
 }
 
+
+//// Streaming base 64 ////
+// Incremental encoder for inputs that arrive, or are produced, in chunks.
+// Only the 0-2 bytes that do not yet form a complete 3-byte group are carried
+// between calls, so the output of any sequence of base64_stream_encode() calls
+// followed by base64_stream_finish() is identical to a single base64_encode()
+// over the concatenated input.
+struct base64_stream_state {
+  char carry[2];
+  size_t carry_len;
+};
+
+static inline void base64_stream_init(base64_stream_state* state) {
+  state->carry_len = 0;
+}
+
+// Number of input bytes that exactly fill an output buffer of dlen bytes.
+static inline size_t base64_stream_input_size(size_t dlen) {
+  return dlen / 4 * 3;
+}
+
+// Encodes as much of src as fits into dst, which only ever receives whole
+// 4-character groups.  *consumed is set to the number of bytes taken from src;
+// it is less than slen only when dst is full, and the caller should flush dst
+// and call again with the rest.  Returns the number of characters written.
+static inline size_t base64_stream_encode(base64_stream_state* state,
+                                          const char* src, size_t slen,
+                                          size_t* consumed,
+                                          char* dst, size_t dlen) {
+  size_t i = 0;
+  size_t k = 0;
+
+  if (state->carry_len > 0 && state->carry_len + slen >= 3 && dlen >= 4) {
+    char group[3];
+    size_t j;
+    for (j = 0; j < state->carry_len; j++)
+      group[j] = state->carry[j];
+    for (; j < 3; j++)
+      group[j] = src[i++];
+    k += base64_encode(group, sizeof(group), dst, dlen);
+    state->carry_len = 0;
+  }
+
+  if (state->carry_len == 0) {
+    size_t groups = (slen - i) / 3;
+    if (groups > (dlen - k) / 4)
+      groups = (dlen - k) / 4;
+    if (groups > 0) {
+      k += base64_encode(src + i, groups * 3, dst + k, dlen - k);
+      i += groups * 3;
+    }
+  }
+
+  // Stash the incomplete trailing group, but only once everything before it
+  // has been written out.
+  if (slen - i < 3 && state->carry_len + (slen - i) < 3) {
+    while (i < slen)
+      state->carry[state->carry_len++] = src[i++];
+  }
+
+  *consumed = i;
+  return k;
+}
+
+// Writes the padded final group, if any; dst must have room for 4 characters.
+// Returns the number of characters written and resets the state.
+static inline size_t base64_stream_finish(base64_stream_state* state,
+                                          char* dst, size_t dlen) {
+  size_t k = 0;
+  if (state->carry_len > 0)
+    k = base64_encode(state->carry, state->carry_len, dst, dlen);
+  state->carry_len = 0;
+  return k;
+}
+
 #endif  // SRC_BASE64_H_
@@ -21,17 +21,33 @@
 */
 
 #include "inspector_agent.h"
+#include "inspector_console.h"
 
+#include "inspector_domains.h"
 #include "inspector_io.h"
+#include "inspector_json.h"
+#include "inspector_logpoints.h"
+#include "inspector_pprof.h"
+#include "inspector_registry.h"
+#include "inspector_script_cache.h"
+#include "inspector_snapshots.h"
+#include "inspector_streams.h"
+#include "inspector_watchdog.h"
 #include "v8-inspector.h"
 #include "v8-platform.h"
+#include "v8-profiler.h"
 #include "zlib.h"
 
 #include "libplatform/libplatform.h"
 #include <cassert>
 
 
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
 #include <vector>
 
 #ifdef __POSIX__
@@ -57,6 +73,108 @@ class StartIoTask : public Task {
   Agent* agent;
 };
 
+class PostedCallbacksTask : public Task {
+ public:
+  explicit PostedCallbacksTask(Agent* agent) : agent_(agent) {}
+
+  void Run() override {
+    agent_->RunPostedCallbacks();
+  }
+
+ private:
+  Agent* agent_;
+};
+
+void PostedCallbacksInterrupt(Isolate* isolate, void* agent) {
+  static_cast<Agent*>(agent)->RunPostedCallbacks();
+}
+
+int64_t WallClockNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string ToUtf8(Local<String> value) {
+  if (value.IsEmpty())
+    return std::string();
+  String::Utf8Value utf8(value);
+  return *utf8 == nullptr ? std::string() : std::string(*utf8, utf8.length());
+}
+
+void AddAllocationNode(SampledProfile* profile, AllocationProfile::Node* node,
+                       std::vector<size_t>* stack) {
+  stack->push_back(profile->AddFrame(ToUtf8(node->name),
+                                     ToUtf8(node->script_name),
+                                     node->line_number,
+                                     node->column_number));
+  int64_t count = 0;
+  int64_t bytes = 0;
+  for (const AllocationProfile::Allocation& allocation : node->allocations) {
+    count += allocation.count;
+    bytes += static_cast<int64_t>(allocation.size) * allocation.count;
+  }
+  if (count > 0) {
+    profile->AddSample(std::vector<size_t>(stack->rbegin(), stack->rend()),
+                       {count, bytes});
+  }
+  for (AllocationProfile::Node* child : node->children)
+    AddAllocationNode(profile, child, stack);
+  stack->pop_back();
+}
+
+void AddCpuProfileNode(SampledProfile* profile, const CpuProfileNode* node,
+                       int64_t sample_interval_ns,
+                       std::vector<size_t>* stack) {
+  stack->push_back(profile->AddFrame(ToUtf8(node->GetFunctionName()),
+                                     ToUtf8(node->GetScriptResourceName()),
+                                     node->GetLineNumber(),
+                                     node->GetColumnNumber()));
+  int64_t hits = node->GetHitCount();
+  if (hits > 0) {
+    profile->AddSample(std::vector<size_t>(stack->rbegin(), stack->rend()),
+                       {hits, hits * sample_interval_ns});
+  }
+  for (int i = 0; i < node->GetChildrenCount(); i++)
+    AddCpuProfileNode(profile, node->GetChild(i), sample_interval_ns, stack);
+  stack->pop_back();
+}
+
+const char kCpuProfileTitle[] = "inspector";
+
+// Heap snapshots written near the heap limit, by all agents
+std::atomic<int> near_limit_snapshots(0);
+
+class FileOutputStream : public OutputStream {
+ public:
+  explicit FileOutputStream(FILE* file) : file_(file), failed_(false) { }
+
+  WriteResult WriteAsciiChunk(char* data, int size) override {
+    if (fwrite(data, 1, size, file_) != static_cast<size_t>(size)) {
+      failed_ = true;
+      return kAbort;
+    }
+    return kContinue;
+  }
+
+  int GetChunkSize() override {
+    return 64 * 1024;
+  }
+
+  void EndOfStream() override { }
+
+  bool failed() const { return failed_; }
+
+ private:
+  FILE* const file_;
+  bool failed_;
+};
+
+#if V8_MAJOR_VERSION > 6 || (V8_MAJOR_VERSION == 6 && V8_MINOR_VERSION >= 7)
+size_t NearHeapLimitCallback(void* agent, size_t current_heap_limit,
+                             size_t initial_heap_limit) {
+  return static_cast<Agent*>(agent)->HeapNearLimit(current_heap_limit);
+}
+#endif
 
 std::unique_ptr<v8_inspector::StringBuffer> ToProtocolString(Local<Value> value) {
   if (value.IsEmpty() || value->IsNull() || value->IsUndefined() ||
@@ -83,11 +201,36 @@ void StartIoInterrupt(Isolate* isolate, void* agent) {
 const int NANOS_PER_MSEC = 1000000;
 const int CONTEXT_GROUP_ID = 1;
 
+// V8 puts "method" first in notifications
+const char kPausedPrefix[] = "{\"method\":\"Debugger.paused\"";
+const char kResumedPrefix[] = "{\"method\":\"Debugger.resumed\"";
+const char kConsoleApiCalledPrefix[] =
+    "{\"method\":\"Runtime.consoleAPICalled\"";
+
+bool MatchesAt(const v8_inspector::StringView& view, size_t offset,
+               const char* text, size_t length) {
+  if (view.length() < offset + length)
+    return false;
+  for (size_t i = 0; i < length; i++) {
+    uint16_t c = view.is8Bit() ? view.characters8()[offset + i]
+                               : view.characters16()[offset + i];
+    if (c != static_cast<unsigned char>(text[i]))
+      return false;
+  }
+  return true;
+}
+
+bool StartsWith(const v8_inspector::StringView& view, const char* prefix) {
+  return MatchesAt(view, 0, prefix, strlen(prefix));
+}
+
 class ChannelImpl final : public v8_inspector::V8Inspector::Channel {
  public:
-  explicit ChannelImpl(v8_inspector::V8Inspector* inspector,
-                       InspectorSessionDelegate* delegate)
-                       : delegate_(delegate) {
+  ChannelImpl(v8_inspector::V8Inspector* inspector,
+              InspectorSessionDelegate* delegate,
+              ConsolePipeline* console)
+              : delegate_(delegate), console_(console),
+                drop_resumed_(false) {
     session_ = inspector->connect(1, this, v8_inspector::StringView());
   }
 
@@ -97,8 +240,44 @@ class ChannelImpl final : public v8_inspector::V8Inspector::Channel {
     session_->dispatchProtocolMessage(message);
   }
 
-  bool waitForFrontendMessage() {
-    return delegate_->WaitForFrontendMessageWhilePaused();
+  bool waitForFrontendMessage(int timeout_ms) {
+    return delegate_->WaitForFrontendMessageWhilePaused(timeout_ms);
+  }
+
+  void resume() {
+    session_->resume();
+  }
+
+  // Lets go of the arguments of console calls V8 reported to the session
+  void ReleaseConsoleGroup() {
+    session_->releaseObjectGroup(Utf8ToStringView("console")->string());
+  }
+
+  // Debugger.paused is held back until the pause is known not to be one
+  // that only snapshot breakpoints see. Sends it, and returns its reason.
+  std::string SendHeldPause() {
+    std::string reason;
+    if (held_pause_ == nullptr)
+      return reason;
+    std::string json = StringViewToUtf8(held_pause_->string());
+    ProtocolEnvelope envelope;
+    ScanProtocolEnvelope(json.data(), json.size(), &envelope);
+    JsonObjectScanner params(envelope.params, envelope.params_length);
+    while (params.Next()) {
+      if (params.KeyIs("reason"))
+        JsonStringValue(params.value(), params.value_length(), &reason);
+    }
+    sendMessageToFrontend(held_pause_->string());
+    held_pause_.reset();
+    return reason;
+  }
+
+  // Drops the held Debugger.paused, and the Debugger.resumed that follows
+  void DropHeldPause() {
+    if (held_pause_ == nullptr)
+      return;
+    held_pause_.reset();
+    drop_resumed_ = true;
   }
 
   void schedulePauseOnNextStatement(const std::string& reason) {
@@ -119,6 +298,20 @@ class ChannelImpl final : public v8_inspector::V8Inspector::Channel {
 
   void sendNotification(
       std::unique_ptr<v8_inspector::StringBuffer> message) override {
+    if (StartsWith(message->string(), kPausedPrefix)) {
+      held_pause_ = std::move(message);
+      return;
+    }
+    if (drop_resumed_ && StartsWith(message->string(), kResumedPrefix)) {
+      drop_resumed_ = false;
+      return;
+    }
+    // The console pipeline sends these in batches
+    if (console_->enabled() &&
+        StartsWith(message->string(), kConsoleApiCalledPrefix)) {
+      console_->NotificationWithheld();
+      return;
+    }
     sendMessageToFrontend(message->string());
   }
 
@@ -129,7 +322,10 @@ class ChannelImpl final : public v8_inspector::V8Inspector::Channel {
   }
 
   InspectorSessionDelegate* const delegate_;
+  ConsolePipeline* const console_;
   std::unique_ptr<v8_inspector::V8InspectorSession> session_;
+  std::unique_ptr<v8_inspector::StringBuffer> held_pause_;
+  bool drop_resumed_;
 };
 
 }  // namespace
@@ -137,25 +333,39 @@ class ChannelImpl final : public v8_inspector::V8Inspector::Channel {
 class CBInspectorClient : public v8_inspector::V8InspectorClient {
  public:
   CBInspectorClient(Isolate* isolate,
-                      Platform* platform) : isolate_(isolate),
+                      Platform* platform,
+                      SlowHandlerWatchdog* watchdog,
+                      PauseWatchdog* pause_watchdog,
+                      ConsolePipeline* console) : isolate_(isolate),
                                                 platform_(platform),
+                                                watchdog_(watchdog),
+                                                pause_watchdog_(pause_watchdog),
+                                                console_(console),
                                                 terminated_(false),
                                                 running_nested_loop_(false) {
     client_ = v8_inspector::V8Inspector::create(isolate_, this);
   }
 
   void runMessageLoopOnPause(int context_group_id) override {
-    assert(channel_ != nullptr);
-    if (running_nested_loop_)
+    if (running_nested_loop_) {
+      if (channel_ != nullptr)
+        channel_->SendHeldPause();
       return;
-    terminated_ = false;
-    running_nested_loop_ = true;
-    while (!terminated_ && channel_->waitForFrontendMessage()) {
-      while (platform::PumpMessageLoop(platform_, isolate_))
-        {}
     }
-    terminated_ = false;
-    running_nested_loop_ = false;
+    // Time spent paused is not JS running long.
+    watchdog_->Suspend();
+    RunPause();
+    watchdog_->Resume();
+  }
+
+  void consoleAPIMessage(int context_group_id,
+                         Isolate::MessageErrorLevel level,
+                         const v8_inspector::StringView& message,
+                         const v8_inspector::StringView& url,
+                         unsigned line_number, unsigned column_number,
+                         v8_inspector::V8StackTrace* stack_trace) override {
+    if (console_->enabled())
+      console_->Add(level, message, url, line_number, column_number);
   }
 
   double currentTimeMS() override {
@@ -180,7 +390,7 @@ class CBInspectorClient : public v8_inspector::V8InspectorClient {
   void connectFrontend(InspectorSessionDelegate* delegate) {
     assert(channel_ == nullptr);
     channel_ = std::unique_ptr<ChannelImpl>(
-        new ChannelImpl(client_.get(), delegate));
+        new ChannelImpl(client_.get(), delegate, console_));
   }
 
   void disconnectFrontend() {
@@ -229,46 +439,219 @@ class CBInspectorClient : public v8_inspector::V8InspectorClient {
     return channel_.get();
   }
 
+  // How long to wait for a frontend message, zero meaning no limit
+  static int WaitTimeoutMs(uint64_t paused_at, uint64_t max_pause) {
+    if (max_pause == 0)
+      return 0;
+    uint64_t paused = uv_hrtime() - paused_at;
+    if (paused >= max_pause)
+      return 1;
+    return static_cast<int>((max_pause - paused) / NANOS_PER_MSEC) + 1;
+  }
+
+  // Resumes a pause that went on for too long, and tells the frontend why.
+  void ForceResume(uint64_t paused_ns) {
+    std::string notification = "{\"method\":\"Pause.timedOut\","
+        "\"params\":{\"pausedMs\":" +
+        std::to_string(paused_ns / NANOS_PER_MSEC) + ",\"maxPauseMs\":" +
+        std::to_string(pause_watchdog_->max_pause_ms()) + "}}";
+    fprintf(stderr, "Paused for longer than %d ms, resuming.\n",
+            pause_watchdog_->max_pause_ms());
+    channel_->resume();
+    channel_->delegate()->SendMessageToFrontend(
+        Utf8ToStringView(notification)->string());
+  }
+
+  void releaseConsoleGroup() {
+    if (channel_ != nullptr)
+      channel_->ReleaseConsoleGroup();
+  }
+
+  SnapshotBreakpoints* snapshots(SnapshotBreakpoints::Callback callback) {
+    if (snapshots_ == nullptr) {
+      snapshots_ = std::unique_ptr<SnapshotBreakpoints>(
+          new SnapshotBreakpoints(client_.get(), CONTEXT_GROUP_ID, callback));
+    }
+    return snapshots_.get();
+  }
+
  private:
+  void RunPause() {
+    uint64_t paused_at = uv_hrtime();
+    if (snapshots_ != nullptr) {
+      if (snapshots_->HandlePause()) {
+        if (channel_ != nullptr)
+          channel_->DropHeldPause();
+        pause_watchdog_->Record("snapshot", uv_hrtime() - paused_at, false);
+        return;
+      }
+      // Paused with no frontend to hand the pause to
+      if (channel_ == nullptr) {
+        snapshots_->Resume();
+        return;
+      }
+    }
+    assert(channel_ != nullptr);
+    std::string reason = channel_->SendHeldPause();
+    const uint64_t max_pause =
+        pause_watchdog_->max_pause_ms() * static_cast<uint64_t>(NANOS_PER_MSEC);
+    bool forced = false;
+    terminated_ = false;
+    running_nested_loop_ = true;
+    while (!terminated_ &&
+           channel_->waitForFrontendMessage(WaitTimeoutMs(paused_at,
+                                                          max_pause))) {
+      while (platform::PumpMessageLoop(platform_, isolate_))
+        {}
+      if (max_pause > 0 && !terminated_ &&
+          uv_hrtime() - paused_at >= max_pause) {
+        ForceResume(uv_hrtime() - paused_at);
+        forced = true;
+      }
+    }
+    terminated_ = false;
+    running_nested_loop_ = false;
+    pause_watchdog_->Record(reason.empty() ? "other" : reason,
+                            uv_hrtime() - paused_at, forced);
+  }
+
   Isolate* isolate_;
   Platform* platform_;
+  SlowHandlerWatchdog* const watchdog_;
+  PauseWatchdog* const pause_watchdog_;
+  ConsolePipeline* const console_;
   bool terminated_;
   bool running_nested_loop_;
   std::unique_ptr<v8_inspector::V8Inspector> client_;
   std::unique_ptr<ChannelImpl> channel_;
+  std::unique_ptr<SnapshotBreakpoints> snapshots_;
 };
 
 Agent::Agent(std::string host_name, std::string file_path) : isolate_(nullptr),
                                  client_(nullptr),
+                                 watchdog_(new SlowHandlerWatchdog()),
+                                 pause_watchdog_(new PauseWatchdog()),
+                                 console_(new ConsolePipeline()),
+                                 streams_(new InspectorStreams()),
+                                 domains_(new InspectorDomains()),
+                                 script_cache_(new InspectorScriptCache()),
+                                 logpoints_(new Logpoints(
+                                     [this]() { return snapshots(); },
+                                     [this](const std::string& method,
+                                            const std::string& params) {
+                                       SendNotification(method, params);
+                                     })),
                                  platform_(nullptr),
+                                 scheduler_(nullptr),
                                  enabled_(false),
                                  host_name_(host_name),
-                                 file_path_(file_path){}
+                                 file_path_(file_path),
+                                 listen_backlog_(ServerSocketOptions().backlog),
+                                 acceptors_(1),
+                                 reuse_port_(false),
+                                 io_loops_(1),
+                                 io_loops_by_peer_address_(false),
+                                 io_loop_(nullptr),
+                                 heap_sampling_(false),
+                                 heap_sample_interval_(0),
+                                 heap_sampling_start_(0),
+                                 cpu_profiler_(nullptr),
+                                 cpu_sample_interval_us_(0),
+                                 cpu_profiling_start_(0),
+                                 near_limit_max_snapshots_(0),
+                                 near_limit_keep_count_(0),
+                                 watchdog_threshold_ms_(0),
+                                 watchdog_max_frames_(0),
+                                 watchdog_max_samples_(0),
+                                 snapshot_writer_(new SnapshotWriter()),
+                                 snapshot_keep_count_(
+                                     SnapshotWriter::kDefaultKeepCount),
+                                 sessions_ended_(0),
+                                 reclaimed_bytes_(0) {}
 
 // Destructor needs to be defined here in implementation file as the header
 // does not have full definition of some classes.
 Agent::~Agent() {
 }
 
+void Agent::SetListenOptions(int backlog, int acceptors, bool reuse_port) {
+  listen_backlog_ = backlog;
+  acceptors_ = acceptors;
+  reuse_port_ = reuse_port;
+}
+
+void Agent::SetMainThreadScheduler(MainThreadScheduler* scheduler) {
+  scheduler_ = scheduler;
+}
+
+void Agent::SetIoLoops(int io_loops, bool by_peer_address) {
+  io_loops_ = io_loops;
+  io_loops_by_peer_address_ = by_peer_address;
+}
+
+bool Agent::EnableTargetRegistry(const std::string& path,
+                                 const std::string& label) {
+  registry_ = TargetRegistry::Open(path);
+  registry_label_ = label;
+  return registry_ != nullptr;
+}
+
+void Agent::SetIoLoop(uv_loop_t* loop,
+                      std::function<void(std::function<void()>)>
+                          post_to_loop) {
+  io_loop_ = loop;
+  post_to_io_loop_ = post_to_loop;
+}
+
 bool Agent::Start(Isolate *isolate, Platform* platform, const char* path) {
+  StartClient(isolate, platform, path);
+  if (true) {
+    // This will return false if listen failed on the inspector port.
+    return StartIoThread(true);
+  }
+  return true;
+}
+
+void Agent::StartAsync(Isolate* isolate, Platform* platform,
+                       const char* path, StartCallback callback) {
+  StartClient(isolate, platform, path);
+  start_callback_ = callback;
+  CreateIo(false);
+  io_->StartAsync();
+}
+
+void Agent::IoStarted(bool listening, int port) {
+  if (io_ == nullptr || !io_->async_start_pending())
+    return;
+  io_->AsyncStartDone(listening);
+  if (!listening)
+    io_.reset();
+  StartCallback callback = start_callback_;
+  if (!listening)
+    start_callback_ = nullptr;
+  if (callback != nullptr)
+    callback(listening ? StartEvent::kListening : StartEvent::kFailed, port);
+}
+
+void Agent::StartClient(Isolate* isolate, Platform* platform,
+                        const char* path) {
   path_ = path == nullptr ? "" : path;
   isolate_ = isolate;
   client_ =
       std::unique_ptr<CBInspectorClient>(
-          new CBInspectorClient(isolate_, platform));
+          new CBInspectorClient(isolate_, platform, watchdog_.get(),
+                                pause_watchdog_.get(), console_.get()));
   client_->contextCreated(isolate_->GetCurrentContext(), "CB debugger context");
+  watchdog_->Enable(isolate_, watchdog_threshold_ms_, watchdog_max_frames_,
+                    watchdog_max_samples_);
   platform_ = platform;
-  assert(0 == uv_async_init(uv_default_loop(),
-                            &start_io_thread_async,
-                            StartIoThreadAsyncCallback));
-  start_io_thread_async.data = this;
-  uv_unref(reinterpret_cast<uv_handle_t*>(&start_io_thread_async));
-
-  if (true) {
-    // This will return false if listen failed on the inspector port.
-    return StartIoThread(true);
+  if (scheduler_ == nullptr) {
+    assert(0 == uv_async_init(uv_default_loop(),
+                              &start_io_thread_async,
+                              StartIoThreadAsyncCallback));
+    start_io_thread_async.data = this;
+    uv_unref(reinterpret_cast<uv_handle_t*>(&start_io_thread_async));
   }
-  return true;
 }
 
 bool Agent::StartIoThread(bool wait_for_connect) {
@@ -277,9 +660,7 @@ bool Agent::StartIoThread(bool wait_for_connect) {
 
   assert(client_ != nullptr);
 
-  enabled_ = true;
-  io_ = std::unique_ptr<InspectorIo>(
-      new InspectorIo(isolate_, platform_, path_, host_name_, true, file_path_, this));
+  CreateIo(true);
   if (!io_->Start()) {
     client_.reset();
     return false;
@@ -288,7 +669,31 @@ bool Agent::StartIoThread(bool wait_for_connect) {
   return true;
 }
 
+void Agent::CreateIo(bool wait_for_connect) {
+  enabled_ = true;
+  ServerSocketOptions options;
+  options.backlog = listen_backlog_;
+  options.acceptors = acceptors_;
+  options.reuse_port = reuse_port_;
+  options.io_loops = io_loops_;
+  options.io_loop_policy = io_loops_by_peer_address_ ?
+      IoLoopPolicy::kHash : IoLoopPolicy::kLeastLoaded;
+  io_ = std::unique_ptr<InspectorIo>(
+      new InspectorIo(isolate_, platform_, path_, host_name_, wait_for_connect,
+                      file_path_, this, options));
+  if (io_loop_ != nullptr)
+    io_->SetEmbedderLoop(io_loop_, post_to_io_loop_);
+  if (registry_ != nullptr)
+    io_->SetTargetRegistry(registry_, registry_label_);
+}
+
 void Agent::Stop() {
+  // The server has to be up, or have failed, before it can be stopped
+  if (io_ != nullptr && io_->async_start_pending()) {
+    bool listening = io_->WaitForAsyncStart();
+    // The call posted by the server finds the start already reported.
+    IoStarted(listening, io_->port());
+  }
   if (io_ != nullptr) {
     io_->Stop();
     io_.reset();
@@ -298,6 +703,11 @@ void Agent::Stop() {
 void Agent::Connect(InspectorSessionDelegate* delegate) {
   enabled_ = true;
   client_->connectFrontend(delegate);
+  if (start_callback_ != nullptr) {
+    StartCallback callback = start_callback_;
+    start_callback_ = nullptr;
+    callback(StartEvent::kConnected, io_ != nullptr ? io_->port() : 0);
+  }
 }
 
 bool Agent::IsConnected() {
@@ -326,7 +736,20 @@ void Agent::Dispatch(const v8_inspector::StringView& message) {
 
 void Agent::Disconnect() {
   assert(client_ != nullptr);
+  HeapStatistics before;
+  isolate_->GetHeapStatistics(&before);
+  // Destroying the session discards every object group it had.
   client_->disconnectFrontend();
+  // Remote objects the frontend never released are garbage now. Collect
+  // them while the heap is not busy with anything else.
+  isolate_->LowMemoryNotification();
+  HeapStatistics after;
+  isolate_->GetHeapStatistics(&after);
+  size_t reclaimed = before.used_heap_size() > after.used_heap_size()
+                         ? before.used_heap_size() - after.used_heap_size()
+                         : 0;
+  sessions_ended_++;
+  reclaimed_bytes_ += reclaimed;
 }
 
 void Agent::RunMessageLoop() {
@@ -348,11 +771,353 @@ void Agent::PauseOnNextJavascriptStatement(const std::string& reason) {
     channel->schedulePauseOnNextStatement(reason);
 }
 
+std::string Agent::OpenStream(const std::string& path, bool base64_encoded,
+                              bool delete_on_close) {
+  return streams_->Open(path, base64_encoded, delete_on_close);
+}
+
+void Agent::CloseStream(const std::string& handle) {
+  streams_->Close(handle);
+}
+
+void Agent::RegisterDomainHandler(const std::string& domain,
+                                  InspectorDomainHandler* handler,
+                                  bool on_main_thread) {
+  domains_->Register(domain, handler, on_main_thread);
+}
+
+void Agent::UnregisterDomainHandler(const std::string& domain) {
+  domains_->Unregister(domain);
+}
+
+void Agent::SendNotification(const std::string& method,
+                             const std::string& params) {
+  InspectorIo* io = io_.get();
+  if (io != nullptr)
+    io->SendToFrontend(InspectorDomains::MakeNotification(method, params));
+}
+
+void Agent::SetScriptSourceCacheSize(size_t max_bytes) {
+  script_cache_->SetMaxBytes(max_bytes);
+}
+
+bool Agent::StartHeapSampling(uint64_t sample_interval, int stack_depth) {
+  if (heap_sampling_)
+    return true;
+  if (!isolate_->GetHeapProfiler()->StartSamplingHeapProfiler(
+          sample_interval, stack_depth)) {
+    return false;
+  }
+  heap_sampling_ = true;
+  heap_sample_interval_ = sample_interval;
+  heap_sampling_start_ = WallClockNanos();
+  return true;
+}
+
+void Agent::StopHeapSampling() {
+  if (!heap_sampling_)
+    return;
+  isolate_->GetHeapProfiler()->StopSamplingHeapProfiler();
+  heap_sampling_ = false;
+}
+
+bool Agent::WriteHeapProfile(const std::string& path_prefix) {
+  if (!heap_sampling_)
+    return false;
+  HandleScope handle_scope(isolate_);
+  std::unique_ptr<AllocationProfile> allocations(
+      isolate_->GetHeapProfiler()->GetAllocationProfile());
+  if (allocations == nullptr)
+    return false;
+  std::unique_ptr<SampledProfile> profile(new SampledProfile(
+      {{"inuse_objects", "count"}, {"inuse_space", "bytes"}},
+      {"space", "bytes"}, heap_sample_interval_));
+  profile->set_time(heap_sampling_start_,
+                    WallClockNanos() - heap_sampling_start_);
+  // The root node is not a frame
+  std::vector<size_t> stack;
+  for (AllocationProfile::Node* child : allocations->GetRootNode()->children)
+    AddAllocationNode(profile.get(), child, &stack);
+  WriteProfileInBackground(std::move(profile), 1, path_prefix);
+  return true;
+}
+
+void Agent::RequestHeapProfile(const std::string& path_prefix) {
+  PostToMainThread([path_prefix](Agent* agent) {
+    if (!agent->WriteHeapProfile(path_prefix))
+      fprintf(stderr, "Heap sampling is not running.\n");
+  });
+}
+
+bool Agent::StartCpuProfiling(int sample_interval_us) {
+  if (cpu_profiler_ != nullptr)
+    return true;
+  if (sample_interval_us <= 0)
+    return false;
+  HandleScope handle_scope(isolate_);
+  cpu_profiler_ = CpuProfiler::New(isolate_);
+  cpu_profiler_->SetSamplingInterval(sample_interval_us);
+  cpu_profiler_->StartProfiling(
+      String::NewFromUtf8(isolate_, kCpuProfileTitle), false);
+  cpu_sample_interval_us_ = sample_interval_us;
+  cpu_profiling_start_ = WallClockNanos();
+  return true;
+}
+
+std::unique_ptr<SampledProfile> Agent::TakeCpuProfile() {
+  if (cpu_profiler_ == nullptr)
+    return nullptr;
+  HandleScope handle_scope(isolate_);
+  CpuProfile* cpu_profile = cpu_profiler_->StopProfiling(
+      String::NewFromUtf8(isolate_, kCpuProfileTitle));
+  std::unique_ptr<SampledProfile> profile;
+  if (cpu_profile != nullptr) {
+    int64_t sample_interval_ns = cpu_sample_interval_us_ * INT64_C(1000);
+    profile.reset(new SampledProfile(
+        {{"samples", "count"}, {"cpu", "nanoseconds"}},
+        {"cpu", "nanoseconds"}, sample_interval_ns));
+    profile->set_time(cpu_profiling_start_,
+                      (cpu_profile->GetEndTime() -
+                       cpu_profile->GetStartTime()) * 1000);
+    // The root node is not a frame
+    const CpuProfileNode* root = cpu_profile->GetTopDownRoot();
+    std::vector<size_t> stack;
+    for (int i = 0; i < root->GetChildrenCount(); i++) {
+      AddCpuProfileNode(profile.get(), root->GetChild(i), sample_interval_ns,
+                        &stack);
+    }
+    cpu_profile->Delete();
+  }
+  cpu_profiler_->Dispose();
+  cpu_profiler_ = nullptr;
+  return profile;
+}
+
+bool Agent::WriteHeapSnapshot(const std::string& path) {
+  std::string temp_path = path + ".tmp";
+  FILE* file = fopen(temp_path.c_str(), "w");
+  if (file == nullptr)
+    return false;
+  HandleScope handle_scope(isolate_);
+  HeapProfiler* heap_profiler = isolate_->GetHeapProfiler();
+  const HeapSnapshot* snapshot = heap_profiler->TakeHeapSnapshot();
+  FileOutputStream stream(file);
+  snapshot->Serialize(&stream, HeapSnapshot::kJSON);
+  const_cast<HeapSnapshot*>(snapshot)->Delete();
+  bool ok = fclose(file) == 0 && !stream.failed();
+  if (ok)
+    ok = rename(temp_path.c_str(), path.c_str()) == 0;
+  if (!ok)
+    unlink(temp_path.c_str());
+  return ok;
+}
+
+bool Agent::EnableHeapSnapshotNearLimit(const std::string& directory,
+                                        int max_snapshots, int keep_count) {
+#if V8_MAJOR_VERSION > 6 || (V8_MAJOR_VERSION == 6 && V8_MINOR_VERSION >= 7)
+  if (max_snapshots <= 0 || keep_count <= 0)
+    return false;
+  bool enabled = !near_limit_directory_.empty();
+  near_limit_directory_ = directory;
+  near_limit_max_snapshots_ = max_snapshots;
+  near_limit_keep_count_ = keep_count;
+  if (!enabled)
+    isolate_->AddNearHeapLimitCallback(NearHeapLimitCallback, this);
+  return true;
+#else
+  return false;
+#endif
+}
+
+size_t Agent::HeapNearLimit(size_t current_heap_limit) {
+  int sequence = ++near_limit_snapshots;
+  if (sequence > near_limit_max_snapshots_) {
+    // Out of snapshots, let the isolate run out of memory as it would have.
+#if V8_MAJOR_VERSION > 6 || (V8_MAJOR_VERSION == 6 && V8_MINOR_VERSION >= 7)
+    isolate_->RemoveNearHeapLimitCallback(NearHeapLimitCallback, 0);
+#endif
+    return current_heap_limit;
+  }
+  char name[64];
+  snprintf(name, sizeof(name), "Heap.%010lld.%d.%d.heapsnapshot",
+           static_cast<long long>(WallClockNanos() / 1000000000),
+           static_cast<int>(getpid()), sequence);
+  std::string path = near_limit_directory_ + "/" + name;
+  fprintf(stderr, "Heap is near its limit, writing %s\n", path.c_str());
+  if (!WriteHeapSnapshot(path))
+    fprintf(stderr, "Could not write %s\n", path.c_str());
+  RotateFiles(near_limit_directory_, "Heap.", ".heapsnapshot",
+              near_limit_keep_count_);
+  // The snapshot needed memory too, roughly in proportion to the heap.
+  return current_heap_limit + current_heap_limit / 2;
+}
+
+bool Agent::StopCpuProfiling(const std::string& path_prefix) {
+  std::unique_ptr<SampledProfile> profile = TakeCpuProfile();
+  if (profile == nullptr)
+    return false;
+  WriteProfileInBackground(std::move(profile), 0, path_prefix);
+  return true;
+}
+
+SnapshotBreakpoints* Agent::snapshots() {
+  if (client_ == nullptr)
+    return nullptr;
+  return client_->snapshots([this](const std::string& snapshot) {
+    SnapshotTaken(snapshot);
+  });
+}
+
+std::string Agent::SetSnapshotBreakpoint(const std::string& url,
+                                         int line_number, int column_number,
+                                         const std::string& condition) {
+  SnapshotBreakpoints* breakpoints = snapshots();
+  if (breakpoints == nullptr)
+    return std::string();
+  return breakpoints->Set(url, line_number, column_number, condition);
+}
+
+void Agent::RemoveSnapshotBreakpoint(const std::string& id) {
+  SnapshotBreakpoints* breakpoints = snapshots();
+  if (breakpoints != nullptr)
+    breakpoints->Remove(id);
+}
+
+bool Agent::SetSnapshotOptions(int max_frames, size_t max_bytes,
+                               const std::string& directory) {
+  SnapshotBreakpoints* breakpoints = snapshots();
+  if (breakpoints == nullptr)
+    return false;
+  breakpoints->SetLimits(max_frames, max_bytes);
+  snapshot_writer_->SetDirectory(directory, snapshot_keep_count_);
+  return true;
+}
+
+bool Agent::SetSnapshotRate(double max_per_second, int burst,
+                            int keep_count) {
+  SnapshotBreakpoints* breakpoints = snapshots();
+  if (breakpoints == nullptr)
+    return false;
+  breakpoints->SetRate(max_per_second, burst);
+  snapshot_keep_count_ = keep_count;
+  snapshot_writer_->set_keep_count(keep_count);
+  return true;
+}
+
+void Agent::SnapshotTaken(const std::string& snapshot) {
+  SendNotification("Snapshot.captured", snapshot);
+  if (!snapshot_writer_->Write(snapshot))
+    fprintf(stderr, "Snapshot writes are behind, dropping a snapshot\n");
+}
+
+std::string Agent::SetLogpoint(const std::string& url, int line_number,
+                               int column_number,
+                               const std::string& expression,
+                               double max_per_second, int burst) {
+  return logpoints_->Set(url, line_number, column_number, expression,
+                         max_per_second, burst);
+}
+
+void Agent::RemoveLogpoint(const std::string& id) {
+  logpoints_->Remove(id);
+}
+
+bool Agent::SetLogpointFile(const std::string& path) {
+  return logpoints_->SetLogFile(path);
+}
+
+void Agent::SetSlowHandlerWatchdog(int threshold_ms, int max_frames,
+                                   size_t max_samples) {
+  watchdog_threshold_ms_ = threshold_ms;
+  watchdog_max_frames_ = max_frames;
+  watchdog_max_samples_ = max_samples;
+}
+
+std::string Agent::GetSlowHandlerSamples() {
+  return watchdog_->SamplesJson();
+}
+
+bool Agent::EnableConsolePipeline(size_t max_bytes, double max_per_second,
+                                  int burst, int flush_interval_ms) {
+  // The IO thread only starts flushing along with the server.
+  if (IsStarted())
+    return false;
+  console_->Enable(max_bytes, max_per_second, burst, flush_interval_ms);
+  return true;
+}
+
+bool Agent::SetConsoleFile(const std::string& path) {
+  return console_->SetFile(path);
+}
+
+void Agent::FlushConsole() {
+  InspectorIo* io = io_.get();
+  std::string params;
+  if (console_->TakeBatch(io != nullptr && io->IsConnected(), &params))
+    SendNotification("Console.messagesAdded", params);
+  if (console_->TakeWithheld()) {
+    PostToMainThread([](Agent* agent) {
+      if (agent->client_ != nullptr)
+        agent->client_->releaseConsoleGroup();
+    });
+  }
+}
+
+void Agent::SetMaxPauseDuration(int max_pause_ms) {
+  pause_watchdog_->set_max_pause_ms(max_pause_ms);
+}
+
+std::string Agent::GetMetrics() {
+  return "{\"slowHandlers\":" + watchdog_->SamplesJson() +
+         ",\"pauses\":" + pause_watchdog_->StatsJson() +
+         ",\"logpoints\":" + logpoints_->StatsJson() +
+         ",\"console\":" + console_->StatsJson() +
+         ",\"endedSessions\":{\"count\":" +
+         std::to_string(sessions_ended_.load()) +
+         ",\"reclaimedBytes\":" + std::to_string(reclaimed_bytes_.load()) +
+         "}}";
+}
+
+void Agent::PostToMainThread(std::function<void(Agent*)> callback) {
+  {
+    std::unique_lock<std::mutex> lock(posted_callbacks_lock_);
+    posted_callbacks_.push_back(std::move(callback));
+  }
+  WakeMainThread(std::unique_ptr<Task>(new PostedCallbacksTask(this)),
+                 PostedCallbacksInterrupt);
+}
+
+void Agent::RunPostedCallbacks() {
+  std::vector<std::function<void(Agent*)>> callbacks;
+  {
+    std::unique_lock<std::mutex> lock(posted_callbacks_lock_);
+    callbacks.swap(posted_callbacks_);
+  }
+  for (const auto& callback : callbacks)
+    callback(this);
+}
+
+void Agent::WakeMainThread(std::unique_ptr<Task> task,
+                           InterruptCallback interrupt) {
+  if (scheduler_ == nullptr) {
+    platform_->CallOnForegroundThread(isolate_, task.release());
+    isolate_->RequestInterrupt(interrupt, this);
+    return;
+  }
+  std::shared_ptr<Task> shared(task.release());
+  scheduler_->PostTask([shared]() { shared->Run(); });
+  if (scheduler_->IsRunningJavaScript())
+    isolate_->RequestInterrupt(interrupt, this);
+  scheduler_->WakeUp();
+}
+
 void Agent::RequestIoThreadStart() {
-  uv_async_send(&start_io_thread_async);
-  platform_->CallOnForegroundThread(isolate_, new StartIoTask(this));
-  isolate_->RequestInterrupt(StartIoInterrupt, this);
-  uv_async_send(&start_io_thread_async);
+  if (scheduler_ == nullptr)
+    uv_async_send(&start_io_thread_async);
+  WakeMainThread(std::unique_ptr<Task>(new StartIoTask(this)),
+                 StartIoInterrupt);
+  if (scheduler_ == nullptr)
+    uv_async_send(&start_io_thread_async);
 }
 
 }  // namespace inspector
@@ -23,10 +23,16 @@
 #ifndef SRC_INSPECTOR_AGENT_H_
 #define SRC_INSPECTOR_AGENT_H_
 
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
+#include "uv.h"
 #include "v8.h"
 #include "v8-inspector.h"
+#include "v8-platform.h"
 
 #include <stddef.h>
 
@@ -37,21 +43,104 @@ using namespace v8;
 class InspectorSessionDelegate {
  public:
   virtual ~InspectorSessionDelegate() = default;
-  virtual bool WaitForFrontendMessageWhilePaused() = 0;
+  // Waits at most timeout_ms for a message, or forever if it is zero.
+  virtual bool WaitForFrontendMessageWhilePaused(int timeout_ms) = 0;
   virtual void SendMessageToFrontend(const v8_inspector::StringView& message)
                                      = 0;
 };
 
+// Serves a protocol domain that V8 does not know about, such as an
+// embedder's "Host" domain. Requests for it never reach the isolate.
+class InspectorDomainHandler {
+ public:
+  virtual ~InspectorDomainHandler() = default;
+  // Handles one "<domain>.<command>" request. params is the JSON of the
+  // request's params object, or empty. Returns true with the JSON of the
+  // result object in *result, or false with a message in *error.
+  virtual bool HandleCommand(const std::string& command,
+                             const std::string& params,
+                             std::string* result, std::string* error) = 0;
+};
+
+// Wakes up the isolate's thread through the embedder's event loop, in place
+// of platform tasks and uv_default_loop() handles. PostTask() and WakeUp()
+// are called from other threads; each batch of work gets one PostTask()
+// and one WakeUp().
+class MainThreadScheduler {
+ public:
+  virtual ~MainThreadScheduler() = default;
+  // Queues task to run on the isolate's thread, outside of JS
+  virtual void PostTask(std::function<void()> task) = 0;
+  // Gets the isolate's thread to run the queued tasks
+  virtual void WakeUp() = 0;
+  // Whether the isolate's thread is in JS, where a task would have to wait.
+  // If so the agent interrupts the isolate as well. Thread-safe.
+  virtual bool IsRunningJavaScript() = 0;
+};
+
 class InspectorIo;
+class InspectorDomains;
+class InspectorScriptCache;
+class InspectorStreams;
+class Logpoints;
 class CBInspectorClient;
+class ConsolePipeline;
+class SampledProfile;
+class PauseWatchdog;
+class SlowHandlerWatchdog;
+class SnapshotBreakpoints;
+class SnapshotWriter;
+class TargetRegistry;
 
 class Agent {
  public:
    __attribute__((visibility("default"))) Agent(std::string host_name, std::string file_path);
   __attribute__((visibility("default"))) ~Agent();
 
+  // Listen backlog of the inspector server, and the number of sockets
+  // accepting on each address (more than one implies SO_REUSEPORT). Takes
+  // effect on the next Start().
+  __attribute__((visibility("default"))) void SetListenOptions(int backlog, int acceptors, bool reuse_port);
+  // Number of loops serving inspector connections, counting the server loop.
+  // Connections go to the least loaded loop, or are hashed by peer address
+  // when by_peer_address is set. Takes effect on the next Start().
+  __attribute__((visibility("default"))) void SetIoLoops(int io_loops, bool by_peer_address);
+  // Lists the agent's target, under label, in the registry file at path
+  // (e.g. under /dev/shm) that all processes share. Tools can then find
+  // every target on the host by mapping that one file; see
+  // inspector_registry.h for its layout. Takes effect on the next Start().
+  // Returns false if the file could not be mapped.
+  __attribute__((visibility("default"))) bool EnableTargetRegistry(const std::string& path, const std::string& label);
+  // Runs the inspector server on the embedder's loop, so that no thread is
+  // created for it. post_to_loop must run the task it is given on the thread
+  // that runs loop, which cannot be the thread that calls Start(). Takes
+  // effect on the next Start().
+  __attribute__((visibility("default"))) void SetIoLoop(uv_loop_t* loop, std::function<void(std::function<void()>)> post_to_loop);
+
+  // Routes wakeups of the isolate's thread through scheduler, which must
+  // outlive the agent. Call before Start().
+  __attribute__((visibility("default"))) void SetMainThreadScheduler(MainThreadScheduler* scheduler);
+  MainThreadScheduler* scheduler() {
+    return scheduler_;
+  }
+
   // Create client_, may create io_ if option enabled
   __attribute__((visibility("default"))) bool Start(Isolate* isolate, Platform* platform, const char* path);
+
+  enum class StartEvent {
+    kListening,
+    kFailed,
+    kConnected
+  };
+  using StartCallback = std::function<void(StartEvent event, int port)>;
+  // Like Start(), but returns straight away instead of waiting for the
+  // server to listen and a frontend to attach. callback is called on the
+  // main thread once the server listens or has failed to, and again when
+  // the first frontend connects. Numeric host names are bound without
+  // being resolved.
+  __attribute__((visibility("default"))) void StartAsync(Isolate* isolate, Platform* platform, const char* path, StartCallback callback);
+  // Main thread, reported by the IO thread after StartAsync()
+  void IoStarted(bool listening, int port);
   // Stop and destroy io_
   __attribute__((visibility("default"))) void Stop();
 
@@ -93,15 +182,207 @@ class Agent {
   // Calls StartIoThread() from off the main thread.
   void RequestIoThreadStart();
 
+  // Exposes a file on disk to the frontend as an IO domain stream and returns
+  // its handle, or an empty string if the file could not be opened. The
+  // frontend reads it with IO.read, served from the IO thread.
+  __attribute__((visibility("default"))) std::string OpenStream(const std::string& path, bool base64_encoded, bool delete_on_close);
+  __attribute__((visibility("default"))) void CloseStream(const std::string& handle);
+
+  InspectorStreams* streams() {
+    return streams_.get();
+  }
+
+  // Routes requests for domain to handler, which must outlive the agent.
+  // The handler runs on the inspector IO thread, or on the main thread when
+  // on_main_thread is set.
+  __attribute__((visibility("default"))) void RegisterDomainHandler(const std::string& domain, InspectorDomainHandler* handler, bool on_main_thread);
+  __attribute__((visibility("default"))) void UnregisterDomainHandler(const std::string& domain);
+  // Sends a "<domain>.<event>" notification to the connected frontend, if
+  // any. params is the JSON of the params object, or empty. Can be called
+  // from any thread.
+  __attribute__((visibility("default"))) void SendNotification(const std::string& method, const std::string& params);
+
+  InspectorDomains* domains() {
+    return domains_.get();
+  }
+
+  // Memory for Debugger.getScriptSource responses kept on the IO thread to
+  // answer repeated requests. Zero disables the cache.
+  __attribute__((visibility("default"))) void SetScriptSourceCacheSize(size_t max_bytes);
+
+  InspectorScriptCache* script_cache() {
+    return script_cache_.get();
+  }
+
+  // Samples allocations, about one per sample_interval bytes allocated,
+  // keeping stack_depth frames of each. At a few MB per sample the overhead
+  // is low enough to leave on in production. Main thread only.
+  __attribute__((visibility("default"))) bool StartHeapSampling(uint64_t sample_interval, int stack_depth);
+  __attribute__((visibility("default"))) void StopHeapSampling();
+  // Writes the sampled allocations that are still live to path_prefix.pb.gz
+  // (pprof) and path_prefix.folded (bytes per stack). Only copying the
+  // profile out of V8 happens on the main thread, it is encoded and written
+  // in the background. Returns false if sampling is not running.
+  __attribute__((visibility("default"))) bool WriteHeapProfile(const std::string& path_prefix);
+  // Calls WriteHeapProfile() on the main thread as soon as it gets to it.
+  // Thread-safe, for triggering a profile from a signal or admin thread.
+  __attribute__((visibility("default"))) void RequestHeapProfile(const std::string& path_prefix);
+
+  // Runs the V8 CPU profiler, taking a sample every sample_interval_us
+  // microseconds. Main thread only.
+  __attribute__((visibility("default"))) bool StartCpuProfiling(int sample_interval_us);
+  // Stops the CPU profiler and writes the profile to path_prefix.pb.gz
+  // (pprof) and path_prefix.folded (samples per stack). Like heap profiles,
+  // it is encoded and written in the background. Returns false if the
+  // profiler was not running.
+  __attribute__((visibility("default"))) bool StopCpuProfiling(const std::string& path_prefix);
+  // Stops the CPU profiler and returns its profile, or nullptr.
+  std::unique_ptr<SampledProfile> TakeCpuProfile();
+
+  // Writes a heap snapshot of the isolate to path, streamed straight to the
+  // file as JSON. Main thread only.
+  __attribute__((visibility("default"))) bool WriteHeapSnapshot(const std::string& path);
+  // When the heap gets close to its limit, raises the limit enough to take a
+  // heap snapshot and writes one into directory, keeping the newest
+  // keep_count snapshots there. At most max_snapshots are written in the
+  // life of the process, counting all agents. Needs V8 6.7 or later, returns
+  // false with older versions.
+  __attribute__((visibility("default"))) bool EnableHeapSnapshotNearLimit(const std::string& directory, int max_snapshots, int keep_count);
+  size_t HeapNearLimit(size_t current_heap_limit);
+
+  // Sets a breakpoint that nobody stops at. When it is hit, and condition
+  // is empty or true, the call frames and their local variables are
+  // recorded, and execution resumes straight away. Snapshots go to the
+  // frontend as Snapshot.captured notifications, and to files if a directory
+  // was set. Returns the breakpoint id, or an empty string. Main thread only,
+  // once started.
+  __attribute__((visibility("default"))) std::string SetSnapshotBreakpoint(const std::string& url, int line_number, int column_number, const std::string& condition);
+  __attribute__((visibility("default"))) void RemoveSnapshotBreakpoint(const std::string& id);
+  // Snapshots cover at most max_frames frames and come to about max_bytes.
+  // If directory is not empty, each is also written there, in the
+  // background. Returns false if the agent is not started.
+  __attribute__((visibility("default"))) bool SetSnapshotOptions(int max_frames, size_t max_bytes, const std::string& directory);
+  // Each snapshot breakpoint takes at most burst snapshots back to back, and
+  // max_per_second on average after that; zero means no limit. The default
+  // is 1 per second with a burst of 5. Only the newest keep_count snapshot
+  // files are left in the directory, 100 by default; zero keeps them all.
+  // Returns false if the agent is not started.
+  __attribute__((visibility("default"))) bool SetSnapshotRate(double max_per_second, int burst, int keep_count);
+
+  // Sets a logpoint: each time the location is hit, the value of expression
+  // is logged instead of pausing. Messages are rate-limited to burst back to
+  // back and max_per_second on average, zero meaning no limit, and dropped
+  // ones are summed up in a Logpoint.suppressed message. Messages go to the
+  // frontend as Logpoint.message notifications, or to the log file if one
+  // is set. Hit counts are in the metrics. Returns the breakpoint id, or an
+  // empty string. Main thread only, once started.
+  __attribute__((visibility("default"))) std::string SetLogpoint(const std::string& url, int line_number, int column_number, const std::string& expression, double max_per_second, int burst);
+  __attribute__((visibility("default"))) void RemoveLogpoint(const std::string& id);
+  // Appends logpoint messages to path, or sends them to the frontend again
+  // if path is empty. Returns false if path could not be opened.
+  __attribute__((visibility("default"))) bool SetLogpointFile(const std::string& path);
+
+  // Records the JS stack, into a ring of max_samples, whenever the isolate
+  // has been running JS for threshold_ms without a break, and again every
+  // threshold_ms for as long as it goes on. The IO thread keeps time and
+  // interrupts the isolate. Takes effect on the next Start().
+  __attribute__((visibility("default"))) void SetSlowHandlerWatchdog(int threshold_ms, int max_frames, size_t max_samples);
+  // The recorded stacks as a JSON array. Thread-safe.
+  __attribute__((visibility("default"))) std::string GetSlowHandlerSamples();
+  SlowHandlerWatchdog* watchdog() {
+    return watchdog_.get();
+  }
+
+  // Captures console calls from the inspector client into a ring of at
+  // most max_bytes of records. Each source location may log burst calls
+  // back to back and max_per_second on average, zero meaning no limit; the
+  // rest are counted. Every flush_interval_ms the IO thread sends what was
+  // captured to the frontend as one Console.messagesAdded notification, in
+  // place of Runtime.consoleAPICalled, or writes it to the console file.
+  // V8 still serializes each call for an attached frontend; only sending it
+  // is saved. Returns false, doing nothing, once the agent is started.
+  __attribute__((visibility("default"))) bool EnableConsolePipeline(size_t max_bytes, double max_per_second, int burst, int flush_interval_ms);
+  // Writes captured console calls to path as JSON lines, or sends them to
+  // the frontend again if path is empty.
+  __attribute__((visibility("default"))) bool SetConsoleFile(const std::string& path);
+  // IO thread
+  void FlushConsole();
+  ConsolePipeline* console() {
+    return console_.get();
+  }
+
+  // Resumes any debugger pause that lasts longer than max_pause_ms, and
+  // sends the frontend a Pause.timedOut notification. Zero, the default,
+  // lets pauses last forever. Pause times are accounted for either way,
+  // by pause reason, in the metrics.
+  __attribute__((visibility("default"))) void SetMaxPauseDuration(int max_pause_ms);
+
+  // Agent state as a JSON object, served at /json/metrics. Thread-safe.
+  std::string GetMetrics();
+
+  SnapshotBreakpoints* snapshots();
+  void SnapshotTaken(const std::string& snapshot);
+
+  // Runs callback on the main thread from the next platform task or
+  // interrupt, whichever comes first. Thread-safe.
+  void PostToMainThread(std::function<void(Agent*)> callback);
+  void RunPostedCallbacks();
+  // Runs task on the main thread, or interrupt if the isolate gets to it
+  // first. Both have to be safe to run twice. Thread-safe.
+  void WakeMainThread(std::unique_ptr<Task> task,
+                      InterruptCallback interrupt);
+
  private:
+  void StartClient(Isolate* isolate, Platform* platform, const char* path);
+  void CreateIo(bool wait_for_connect);
+
   std::unique_ptr<CBInspectorClient> client_;
+  // Used from the IO thread, so these have to outlive io_
+  std::unique_ptr<SlowHandlerWatchdog> watchdog_;
+  std::unique_ptr<PauseWatchdog> pause_watchdog_;
+  std::unique_ptr<ConsolePipeline> console_;
   std::unique_ptr<InspectorIo> io_;
+  std::unique_ptr<InspectorStreams> streams_;
+  std::unique_ptr<InspectorDomains> domains_;
+  std::unique_ptr<InspectorScriptCache> script_cache_;
+  // Sets breakpoints through client_, so it goes first
+  std::unique_ptr<Logpoints> logpoints_;
   Platform* platform_;
+  MainThreadScheduler* scheduler_;
   Isolate* isolate_;
   bool enabled_;
   std::string path_;
   std::string host_name_;
   std::string file_path_;
+  int listen_backlog_;
+  int acceptors_;
+  bool reuse_port_;
+  int io_loops_;
+  bool io_loops_by_peer_address_;
+  uv_loop_t* io_loop_;
+  std::function<void(std::function<void()>)> post_to_io_loop_;
+  StartCallback start_callback_;
+  std::shared_ptr<TargetRegistry> registry_;
+  std::string registry_label_;
+  bool heap_sampling_;
+  uint64_t heap_sample_interval_;
+  int64_t heap_sampling_start_;
+  std::mutex posted_callbacks_lock_;
+  std::vector<std::function<void(Agent*)>> posted_callbacks_;
+  CpuProfiler* cpu_profiler_;
+  int cpu_sample_interval_us_;
+  int64_t cpu_profiling_start_;
+  std::string near_limit_directory_;
+  int near_limit_max_snapshots_;
+  int near_limit_keep_count_;
+  int watchdog_threshold_ms_;
+  int watchdog_max_frames_;
+  size_t watchdog_max_samples_;
+  std::unique_ptr<SnapshotWriter> snapshot_writer_;
+  int snapshot_keep_count_;
+  // Read by GetMetrics() off the main thread
+  std::atomic<uint64_t> sessions_ended_;
+  std::atomic<uint64_t> reclaimed_bytes_;
 };
 
 }  // namespace inspector
@@ -0,0 +1,193 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#include "inspector_console.h"
+
+#include "inspector_io.h"
+#include "inspector_json.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace inspector {
+
+namespace {
+
+const size_t kDefaultMaxBytes = 1024 * 1024;
+// Past this many locations, rate limiting starts over
+const size_t kMaxBuckets = 4096;
+
+const char* LevelName(v8::Isolate::MessageErrorLevel level) {
+  switch (level) {
+    case v8::Isolate::kMessageDebug:
+      return "debug";
+    case v8::Isolate::kMessageInfo:
+      return "info";
+    case v8::Isolate::kMessageError:
+      return "error";
+    case v8::Isolate::kMessageWarning:
+      return "warning";
+    default:
+      return "log";
+  }
+}
+
+}  // namespace
+
+ConsolePipeline::ConsolePipeline() : flush_interval_ms_(0), withheld_(false),
+                                     file_(nullptr),
+                                     max_bytes_(kDefaultMaxBytes),
+                                     max_per_second_(0), burst_(1),
+                                     bytes_(0), added_(0), dropped_(0),
+                                     suppressed_(0), batches_(0) { }
+
+ConsolePipeline::~ConsolePipeline() {
+  if (file_ != nullptr)
+    fclose(file_);
+}
+
+void ConsolePipeline::Enable(size_t max_bytes, double max_per_second,
+                             int burst, int flush_interval_ms) {
+  std::lock_guard<std::mutex> lock(lock_);
+  max_bytes_ = max_bytes;
+  max_per_second_ = std::max(max_per_second, 0.0);
+  burst_ = std::max(burst, 1);
+  buckets_.clear();
+  flush_interval_ms_ = std::max(flush_interval_ms, 0);
+}
+
+bool ConsolePipeline::SetFile(const std::string& path) {
+  FILE* file = nullptr;
+  if (!path.empty()) {
+    file = fopen(path.c_str(), "a");
+    if (file == nullptr)
+      return false;
+  }
+  std::lock_guard<std::mutex> lock(file_lock_);
+  if (file_ != nullptr)
+    fclose(file_);
+  file_ = file;
+  return true;
+}
+
+void ConsolePipeline::Add(v8::Isolate::MessageErrorLevel level,
+                          const v8_inspector::StringView& message,
+                          const v8_inspector::StringView& url,
+                          unsigned line_number, unsigned column_number) {
+  std::string url_utf8 = StringViewToUtf8(url);
+  std::string location;
+  location += "\"url\":";
+  AppendJsonString(&location, url_utf8.data(), url_utf8.size());
+  location += ",\"lineNumber\":" + std::to_string(line_number) +
+              ",\"columnNumber\":" + std::to_string(column_number);
+
+  std::lock_guard<std::mutex> lock(lock_);
+  added_++;
+  if (max_per_second_ > 0) {
+    if (buckets_.size() >= kMaxBuckets)
+      buckets_.clear();
+    auto inserted = buckets_.emplace(location, TokenBucket(burst_));
+    if (!inserted.first->second.Take(max_per_second_, burst_)) {
+      suppressed_++;
+      unreported_[location]++;
+      return;
+    }
+  }
+
+  int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  std::string text = StringViewToUtf8(message);
+  std::string record = "{\"level\":\"";
+  record += LevelName(level);
+  record += "\",\"text\":";
+  AppendJsonString(&record, text.data(), text.size());
+  record += "," + location + ",\"timestamp\":" + std::to_string(now_ms) + "}";
+  if (record.size() > max_bytes_) {
+    dropped_++;
+    return;
+  }
+  while (bytes_ + record.size() > max_bytes_) {
+    bytes_ -= records_.front().size();
+    records_.pop_front();
+    dropped_++;
+  }
+  bytes_ += record.size();
+  records_.push_back(std::move(record));
+}
+
+bool ConsolePipeline::TakeBatch(bool connected, std::string* params) {
+  std::lock_guard<std::mutex> file_lock(file_lock_);
+  std::deque<std::string> records;
+  std::map<std::string, uint64_t> unreported;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (file_ == nullptr && !connected)
+      return false;
+    if (records_.empty() && unreported_.empty())
+      return false;
+    records.swap(records_);
+    unreported.swap(unreported_);
+    bytes_ = 0;
+    batches_++;
+  }
+  // Written outside lock_, so that Add() does not wait on the disk
+  if (file_ != nullptr) {
+    for (const std::string& record : records) {
+      fwrite(record.data(), 1, record.size(), file_);
+      fputc('\n', file_);
+    }
+    for (const auto& location : unreported) {
+      fprintf(file_, "{\"suppressed\":%llu,%s}\n",
+              static_cast<unsigned long long>(location.second),
+              location.first.c_str());
+    }
+    fflush(file_);
+    return false;
+  }
+  *params = "{\"messages\":[";
+  for (const std::string& record : records) {
+    if (params->back() != '[')
+      params->push_back(',');
+    *params += record;
+  }
+  *params += "],\"suppressed\":[";
+  for (const auto& location : unreported) {
+    if (params->back() != '[')
+      params->push_back(',');
+    *params += "{\"count\":" + std::to_string(location.second) + "," +
+               location.first + "}";
+  }
+  *params += "]}";
+  return true;
+}
+
+std::string ConsolePipeline::StatsJson() {
+  std::lock_guard<std::mutex> lock(lock_);
+  return "{\"added\":" + std::to_string(added_) +
+         ",\"buffered\":" + std::to_string(records_.size()) +
+         ",\"bufferedBytes\":" + std::to_string(bytes_) +
+         ",\"dropped\":" + std::to_string(dropped_) +
+         ",\"suppressed\":" + std::to_string(suppressed_) +
+         ",\"batches\":" + std::to_string(batches_) + "}";
+}
+
+}  // namespace inspector
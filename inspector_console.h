@@ -0,0 +1,113 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#ifndef SRC_INSPECTOR_CONSOLE_H_
+#define SRC_INSPECTOR_CONSOLE_H_
+
+#include "inspector_util.h"
+#include "v8-inspector.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace inspector {
+
+// Console calls, taken from the inspector client as they happen and kept
+// as JSON records in a ring with a byte cap. Each source location gets a
+// token bucket, and calls past its rate are only counted. The IO thread
+// takes the records in batches, for the frontend or a local file, in place
+// of V8's one Runtime.consoleAPICalled notification per call.
+//
+// V8 still builds each of those notifications while a frontend is attached,
+// wrapping the arguments into the session's "console" object group, and
+// the agent only withholds them. The agent releases that group after each
+// flush that follows a withheld notification.
+class ConsolePipeline {
+ public:
+  ConsolePipeline();
+  ~ConsolePipeline();
+
+  // Keeps up to max_bytes of records, and lets each location log burst
+  // calls back to back and max_per_second on average after that, zero
+  // meaning no limit. The IO thread flushes every flush_interval_ms; zero
+  // disables the pipeline.
+  void Enable(size_t max_bytes, double max_per_second, int burst,
+              int flush_interval_ms);
+  bool enabled() const { return flush_interval_ms_ > 0; }
+  int flush_interval_ms() const { return flush_interval_ms_; }
+  // Writes records to path, one JSON object per line, instead of sending
+  // them to the frontend. An empty path goes back to the frontend. Returns
+  // false if path could not be opened.
+  bool SetFile(const std::string& path);
+
+  // Main thread, from V8InspectorClient::consoleAPIMessage()
+  void Add(v8::Isolate::MessageErrorLevel level,
+           const v8_inspector::StringView& message,
+           const v8_inspector::StringView& url, unsigned line_number,
+           unsigned column_number);
+  // Takes the buffered records. With a file set they are written there and
+  // false is returned. Otherwise, if connected, *params is set to the params
+  // of a batch notification. Records stay buffered for later sessions while
+  // nobody is connected. IO thread.
+  bool TakeBatch(bool connected, std::string* params);
+
+  // Main thread, for each Runtime.consoleAPICalled not sent
+  void NotificationWithheld() { withheld_ = true; }
+  // Whether a notification was withheld since the last call. Thread-safe.
+  bool TakeWithheld() { return withheld_.exchange(false); }
+
+  // Counters as a JSON object. Thread-safe.
+  std::string StatsJson();
+
+ private:
+  std::atomic<int> flush_interval_ms_;
+  std::atomic<bool> withheld_;
+  // Guards file_, which is written to outside lock_
+  std::mutex file_lock_;
+  FILE* file_;
+  std::mutex lock_;
+  size_t max_bytes_;
+  double max_per_second_;
+  double burst_;
+  std::deque<std::string> records_;
+  size_t bytes_;
+  // Token buckets, by "url:line:column"
+  std::unordered_map<std::string, TokenBucket> buckets_;
+  // Calls over the rate since the last batch, by location as JSON members
+  std::map<std::string, uint64_t> unreported_;
+  uint64_t added_;
+  uint64_t dropped_;
+  uint64_t suppressed_;
+  uint64_t batches_;
+};
+
+}  // namespace inspector
+
+#endif  // SRC_INSPECTOR_CONSOLE_H_
@@ -0,0 +1,103 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#include "inspector_domains.h"
+
+#include "inspector_agent.h"
+#include "inspector_json.h"
+
+namespace inspector {
+
+InspectorDomains::InspectorDomains() : count_(0) { }
+
+void InspectorDomains::Register(const std::string& domain,
+                                InspectorDomainHandler* handler,
+                                bool on_main_thread) {
+  std::unique_lock<std::mutex> lock(lock_);
+  handlers_[domain] = Entry{handler, on_main_thread};
+  count_ = handlers_.size();
+}
+
+void InspectorDomains::Unregister(const std::string& domain) {
+  std::unique_lock<std::mutex> lock(lock_);
+  handlers_.erase(domain);
+  count_ = handlers_.size();
+}
+
+bool InspectorDomains::Find(const std::string& method, Entry* entry) {
+  size_t dot = method.find('.');
+  if (dot == std::string::npos)
+    return false;
+  std::unique_lock<std::mutex> lock(lock_);
+  auto it = handlers_.find(method.substr(0, dot));
+  if (it == handlers_.end())
+    return false;
+  *entry = it->second;
+  return true;
+}
+
+InspectorDomains::Route InspectorDomains::RouteFor(const std::string& method) {
+  Entry entry;
+  if (count_ == 0 || !Find(method, &entry))
+    return Route::kV8;
+  return entry.on_main_thread ? Route::kMainThread : Route::kIoThread;
+}
+
+void InspectorDomains::Dispatch(const ProtocolEnvelope& envelope,
+                                std::string* response) {
+  Entry entry;
+  if (!Find(envelope.method, &entry)) {
+    std::string message = "'" + envelope.method + "' wasn't found";
+    MakeErrorResponse(response, envelope.id, kProtocolMethodNotFound,
+                      message.c_str());
+    return;
+  }
+  std::string command = envelope.method.substr(envelope.method.find('.') + 1);
+  std::string params;
+  if (envelope.params != nullptr)
+    params.assign(envelope.params, envelope.params_length);
+  std::string result;
+  std::string error;
+  if (!entry.handler->HandleCommand(command, params, &result, &error)) {
+    MakeErrorResponse(response, envelope.id, kProtocolServerError,
+                      error.c_str());
+    return;
+  }
+  response->clear();
+  AppendResponsePrefix(response, envelope.id);
+  response->append(",\"result\":");
+  response->append(result.empty() ? "{}" : result);
+  response->push_back('}');
+}
+
+// static
+std::string InspectorDomains::MakeNotification(const std::string& method,
+                                               const std::string& params) {
+  std::string message = "{\"method\":";
+  AppendJsonString(&message, method.data(), method.size());
+  message.append(",\"params\":");
+  message.append(params.empty() ? "{}" : params);
+  message.push_back('}');
+  return message;
+}
+
+}  // namespace inspector
@@ -0,0 +1,77 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#ifndef SRC_INSPECTOR_DOMAINS_H_
+#define SRC_INSPECTOR_DOMAINS_H_
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace inspector {
+
+class InspectorDomainHandler;
+struct ProtocolEnvelope;
+
+// Protocol domains served by embedder handlers instead of V8, keyed by
+// domain name. All methods are thread-safe.
+class InspectorDomains {
+ public:
+  enum class Route {
+    kV8,
+    kIoThread,
+    kMainThread
+  };
+
+  InspectorDomains();
+
+  void Register(const std::string& domain, InspectorDomainHandler* handler,
+                bool on_main_thread);
+  void Unregister(const std::string& domain);
+
+  // Where a request for method is to be handled.
+  Route RouteFor(const std::string& method);
+  // Runs the handler for the request and builds its response. A domain that
+  // was unregistered in the meantime gets a "method not found" error.
+  void Dispatch(const ProtocolEnvelope& envelope, std::string* response);
+
+  static std::string MakeNotification(const std::string& method,
+                                      const std::string& params);
+
+ private:
+  struct Entry {
+    InspectorDomainHandler* handler;
+    bool on_main_thread;
+  };
+
+  bool Find(const std::string& method, Entry* entry);
+
+  std::mutex lock_;
+  std::map<std::string, Entry> handlers_;
+  // Lets RouteFor() skip the lock while no handler is registered
+  std::atomic<size_t> count_;
+};
+
+}  // namespace inspector
+
+#endif  // SRC_INSPECTOR_DOMAINS_H_
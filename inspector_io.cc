@@ -24,10 +24,20 @@
 #include "inspector_socket_server.h"
 #include "inspector_socket.h"
 #include "inspector_agent.h"
+#include "inspector_console.h"
+#include "inspector_domains.h"
+#include "inspector_json.h"
+#include "inspector_registry.h"
+#include "inspector_script_cache.h"
+#include "inspector_streams.h"
+#include "inspector_watchdog.h"
 #include "v8-inspector.h"
 #include "v8-platform.h"
 #include "zlib.h"
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <sstream>
 #include <unicode/unistr.h>
 
@@ -91,6 +101,29 @@ std::string GenerateID() {
   return uuid;
 }
 
+void HandleSyncCloseCb(uv_handle_t* handle) {
+  *static_cast<bool*>(handle->data) = true;
+}
+
+int CloseAsyncAndLoop(uv_async_t* async) {
+  bool is_closed = false;
+  async->data = &is_closed;
+  uv_close(reinterpret_cast<uv_handle_t*>(async), HandleSyncCloseCb);
+  while (!is_closed)
+    uv_run(async->loop, UV_RUN_ONCE);
+  async->data = nullptr;
+  return uv_loop_close(async->loop);
+}
+
+// Delete main_thread_req_ on async handle close
+void ReleasePairOnAsyncClose(uv_handle_t* async) {
+  AsyncAndAgent* pair = ContainerOf(&AsyncAndAgent::first,
+                                          reinterpret_cast<uv_async_t*>(async));
+  delete pair;
+}
+
+}  // namespace
+
 std::string StringViewToUtf8(const StringView& view) {
   if (view.is8Bit()) {
     return std::string(reinterpret_cast<const char*>(view.characters8()),
@@ -116,29 +149,6 @@ std::string StringViewToUtf8(const StringView& view) {
   return result;
 }
 
-void HandleSyncCloseCb(uv_handle_t* handle) {
-  *static_cast<bool*>(handle->data) = true;
-}
-
-int CloseAsyncAndLoop(uv_async_t* async) {
-  bool is_closed = false;
-  async->data = &is_closed;
-  uv_close(reinterpret_cast<uv_handle_t*>(async), HandleSyncCloseCb);
-  while (!is_closed)
-    uv_run(async->loop, UV_RUN_ONCE);
-  async->data = nullptr;
-  return uv_loop_close(async->loop);
-}
-
-// Delete main_thread_req_ on async handle close
-void ReleasePairOnAsyncClose(uv_handle_t* async) {
-  AsyncAndAgent* pair = ContainerOf(&AsyncAndAgent::first,
-                                          reinterpret_cast<uv_async_t*>(async));
-  delete pair;
-}
-
-}  // namespace
-
 std::unique_ptr<StringBuffer> Utf8ToStringView(const std::string& message) {
   UnicodeString utf16 =
       UnicodeString::fromUTF8(StringPiece(message.data(), message.length()));
@@ -151,7 +161,7 @@ std::unique_ptr<StringBuffer> Utf8ToStringView(const std::string& message) {
 class IoSessionDelegate : public InspectorSessionDelegate {
  public:
   explicit IoSessionDelegate(InspectorIo* io) : io_(io) { }
-  bool WaitForFrontendMessageWhilePaused() override;
+  bool WaitForFrontendMessageWhilePaused(int timeout_ms) override;
   void SendMessageToFrontend(const v8_inspector::StringView& message) override;
  private:
   InspectorIo* io_;
@@ -162,7 +172,9 @@ class IoSessionDelegate : public InspectorSessionDelegate {
 class InspectorIoDelegate: public inspector::SocketServerDelegate {
  public:
   InspectorIoDelegate(InspectorIo* io, const std::string& script_path,
-                      const std::string& script_name, bool wait);
+                      const std::string& script_name, bool wait,
+                      InspectorStreams* streams, InspectorDomains* domains,
+                      InspectorScriptCache* script_cache);
   // Calls PostIncomingMessage() with appropriate InspectorAction:
   //   kStartSession
   bool StartSession(int session_id, const std::string& target_id) override;
@@ -174,19 +186,64 @@ class InspectorIoDelegate: public inspector::SocketServerDelegate {
   std::vector<std::string> GetTargetIds() override;
   std::string GetTargetTitle(const std::string& id) override;
   std::string GetTargetUrl(const std::string& id) override;
+  std::string GetMetrics() override;
+  int OpenStreamFile(const std::string& handle, int64_t* size) override;
   bool IsConnected() { return connected_; }
   void ServerDone() override {
     io_->ServerDone();
   }
 
+  // Lets the delegate answer requests on the IO thread without going
+  // through the isolate thread.
+  template <typename Transport>
+  void AttachTransport(Transport* transport) {
+    send_to_frontend_ = [transport](int session_id,
+                                    const std::string& message) {
+      transport->Send(session_id, message);
+    };
+    current_io_loop_ = [transport]() { return transport->CurrentIoLoop(); };
+  }
+
  private:
   InspectorIo* io_;
-  bool connected_;
+  InspectorStreams* const streams_;
+  InspectorDomains* const domains_;
+  InspectorScriptCache* const script_cache_;
+  std::function<void(int, const std::string&)> send_to_frontend_;
+  std::function<int()> current_io_loop_;
+  // Sessions may start on any IO loop
+  std::atomic<bool> connected_;
   int session_id_;
   const std::string script_name_;
   const std::string script_path_;
   const std::string target_id_;
-  bool waiting_;
+  std::atomic<bool> waiting_;
+};
+
+// The server and its delegate, for as long as they run on a loop
+template <typename Transport>
+struct LoopServer {
+  LoopServer(InspectorIo* io, uv_loop_t* loop, const std::string& script_name,
+             bool wait, const std::string& host_name, int port, FILE* out,
+             const ServerSocketOptions& options)
+      : out_file(out, CloseFile),
+        delegate(io, ScriptPath(loop, script_name), script_name, wait,
+                 io->agent()->streams(), io->agent()->domains(),
+                 io->agent()->script_cache()),
+        server(&delegate, loop, host_name, port, out, options),
+        queue_transport(&server, io) {
+    delegate.AttachTransport(&server);
+  }
+
+  static int CloseFile(FILE* file) {
+    return file != nullptr ? fclose(file) : 0;
+  }
+
+  // Where the server prints the frontend URL, closed after the server goes
+  std::unique_ptr<FILE, int (*)(FILE*)> out_file;
+  InspectorIoDelegate delegate;
+  Transport server;
+  TransportAndIo<Transport> queue_transport;
 };
 
 void InterruptCallback(Isolate*, void* agent) {
@@ -212,18 +269,32 @@ class DispatchMessagesTask : public Task {
 InspectorIo::InspectorIo(Isolate* isolate, Platform* platform,
                          const std::string& path, std::string host_name,
                          bool wait_for_connect, std::string file_path,
-                         Agent *agent)
+                         Agent *agent,
+                         const ServerSocketOptions& server_options)
                          : thread_(), delegate_(nullptr),
                            state_(State::kNew), isolate_(isolate),
-                           thread_req_(), platform_(platform),
+                           thread_req_(), watchdog_timer_(),
+                           watchdog_timer_started_(false), console_timer_(),
+                           console_timer_started_(false),
+                           embedder_loop_(nullptr), async_start_(false),
+                           async_listening_(false),
+                           async_start_pending_(false),
+                           async_start_waited_(false), registry_slot_(-1),
+                           session_io_loop_(-1),
+                           platform_(platform),
                            dispatching_messages_(false), session_id_(0),
                            script_name_(path),
                            wait_for_connect_(wait_for_connect), host_name_(host_name), port_(0),
-                           file_path_(file_path), agent_(agent){
-  main_thread_req_ = new AsyncAndAgent({uv_async_t(), agent_});
-  assert(0 == uv_async_init(uv_default_loop(), &main_thread_req_->first,
-                            InspectorIo::MainThreadReqAsyncCb));
-  uv_unref(reinterpret_cast<uv_handle_t*>(&main_thread_req_->first));
+                           file_path_(file_path), agent_(agent),
+                           server_options_(server_options) {
+  // With a scheduler, the embedder's loop is woken up through it instead
+  main_thread_req_ = nullptr;
+  if (agent_->scheduler() == nullptr) {
+    main_thread_req_ = new AsyncAndAgent({uv_async_t(), agent_});
+    assert(0 == uv_async_init(uv_default_loop(), &main_thread_req_->first,
+                              InspectorIo::MainThreadReqAsyncCb));
+    uv_unref(reinterpret_cast<uv_handle_t*>(&main_thread_req_->first));
+  }
   assert(0 == uv_sem_init(&thread_start_sem_, 0));
   //uv_cond_init(&incoming_message_cond_);
   //uv_mutex_init(&state_lock_);
@@ -231,13 +302,34 @@ InspectorIo::InspectorIo(Isolate* isolate, Platform* platform,
 
 InspectorIo::~InspectorIo() {
   uv_sem_destroy(&thread_start_sem_);
-  uv_close(reinterpret_cast<uv_handle_t*>(&main_thread_req_->first),
-           ReleasePairOnAsyncClose);
+  if (main_thread_req_ != nullptr) {
+    uv_close(reinterpret_cast<uv_handle_t*>(&main_thread_req_->first),
+             ReleasePairOnAsyncClose);
+  }
+}
+
+void InspectorIo::SetTargetRegistry(std::shared_ptr<TargetRegistry> registry,
+                                    const std::string& label) {
+  assert(state_ == State::kNew);
+  registry_ = registry;
+  registry_label_ = label;
+}
+
+void InspectorIo::SetEmbedderLoop(uv_loop_t* loop,
+                                  std::function<void(std::function<void()>)>
+                                      post_to_loop) {
+  assert(state_ == State::kNew);
+  embedder_loop_ = loop;
+  post_to_embedder_loop_ = post_to_loop;
 }
 
 bool InspectorIo::Start() {
   assert(state_ == State::kNew);
-  assert(uv_thread_create(&thread_, InspectorIo::ThreadMain, this) == 0);
+  if (embedder_loop_ != nullptr) {
+    post_to_embedder_loop_([this]() { StartOnEmbedderLoop(); });
+  } else {
+    assert(uv_thread_create(&thread_, InspectorIo::ThreadMain, this) == 0);
+  }
   uv_sem_wait(&thread_start_sem_);
 
   if (state_ == State::kError) {
@@ -250,11 +342,51 @@ bool InspectorIo::Start() {
   return true;
 }
 
+void InspectorIo::StartAsync() {
+  assert(state_ == State::kNew);
+  async_start_ = true;
+  async_start_pending_ = true;
+  // Messages written from now on are queued, and the state only moves on
+  // once thread_req_ is ready, in ServerStarted(). Stop() waits for that.
+  if (embedder_loop_ != nullptr) {
+    post_to_embedder_loop_([this]() { StartOnEmbedderLoop(); });
+  } else {
+    assert(uv_thread_create(&thread_, InspectorIo::ThreadMain, this) == 0);
+  }
+}
+
+bool InspectorIo::WaitForAsyncStart() {
+  assert(async_start_pending_);
+  if (!async_start_waited_)
+    uv_sem_wait(&thread_start_sem_);
+  async_start_waited_ = true;
+  // Safe, written before the semaphore was posted
+  return async_listening_;
+}
+
+void InspectorIo::AsyncStartDone(bool listening) {
+  // Takes the post ServerStarted() made, unless the wait already did, so
+  // that Stop() waits for the right one on an embedder loop.
+  WaitForAsyncStart();
+  async_start_pending_ = false;
+  if (listening)
+    return;
+  state_ = State::kError;
+  if (embedder_loop_ == nullptr) {
+    int err = uv_thread_join(&thread_);
+    assert(err == 0);
+  }
+}
+
 void InspectorIo::Stop() {
   assert(state_ == State::kAccepting || state_ == State::kConnected);
   Write(TransportAction::kKill, 0, StringView());
-  int err = uv_thread_join(&thread_);
-  assert(err == 0);
+  if (embedder_loop_ != nullptr) {
+    uv_sem_wait(&thread_start_sem_);
+  } else {
+    int err = uv_thread_join(&thread_);
+    assert(err == 0);
+  }
   state_ = State::kShutDown;
   DispatchMessages();
 }
@@ -294,9 +426,24 @@ void InspectorIo::IoThreadAsyncCb(uv_async_t* async) {
   }
   Transport* transport = transport_and_io->first;
   InspectorIo* io = transport_and_io->second;
+  io->SendQueuedMessages(transport, &io->outgoing_message_queue_);
+}
+
+template <typename Transport>
+void InspectorIo::SendQueuedMessages(Transport* transport,
+                                     MessageQueue<TransportAction>* queue) {
   MessageQueue<TransportAction> outgoing_message_queue;
-  io->SwapBehindLock(&io->outgoing_message_queue_, &outgoing_message_queue);
+  SwapBehindLock(queue, &outgoing_message_queue);
+  // Consecutive messages for the same session go out in a single write.
+  std::vector<std::string> batch;
+  int batch_session_id = 0;
   for (const auto& outgoing : outgoing_message_queue) {
+    if (!batch.empty() && (std::get<0>(outgoing) !=
+                               TransportAction::kSendMessage ||
+                           std::get<1>(outgoing) != batch_session_id)) {
+      transport->Send(batch_session_id, std::move(batch));
+      batch.clear();
+    }
     switch (std::get<0>(outgoing)) {
     case TransportAction::kKill:
       transport->TerminateConnections();
@@ -305,12 +452,70 @@ void InspectorIo::IoThreadAsyncCb(uv_async_t* async) {
       transport->Stop(nullptr);
       break;
     case TransportAction::kSendMessage:
-      std::string message = StringViewToUtf8(std::get<2>(outgoing)->string());
-      //fprintf(stderr, "%d %s sending message %s \n", __LINE__, __FILE__, message.c_str());
-      transport->Send(std::get<1>(outgoing), message);
+      batch_session_id = std::get<1>(outgoing);
+      batch.push_back(StringViewToUtf8(std::get<2>(outgoing)->string()));
+      agent_->script_cache()->MessageSent(batch.back());
       break;
     }
   }
+  if (!batch.empty())
+    transport->Send(batch_session_id, std::move(batch));
+}
+
+template<typename Transport>
+bool InspectorIo::StartServer(uv_loop_t* loop) {
+  thread_req_.data = nullptr;
+  int err = uv_async_init(loop, &thread_req_, IoThreadAsyncCb<Transport>);
+  assert(err == 0);
+  LoopServer<Transport>* server =
+      new LoopServer<Transport>(this, loop, script_name_, wait_for_connect_,
+                                host_name_, port_,
+                                fopen(file_path_.c_str(), "w"),
+                                server_options_);
+  delete_server_ = [server]() { delete server; };
+  delegate_ = &server->delegate;
+  thread_req_.data = &server->queue_transport;
+  Transport* transport = &server->server;
+  post_to_session_loop_ = [this, transport](int io_loop) {
+    return transport->PostToIoLoop(io_loop, [this, transport]() {
+      SendQueuedMessages(transport, &session_message_queue_);
+    });
+  };
+  if (!server->server.Start())
+    return false;
+  port_ = server->server.Port();  // Safe, main thread is waiting on semaphore.
+  int watchdog_interval = agent_->watchdog()->check_interval_ms();
+  if (watchdog_interval > 0) {
+    err = uv_timer_init(loop, &watchdog_timer_);
+    assert(err == 0);
+    watchdog_timer_.data = this;
+    err = uv_timer_start(&watchdog_timer_, WatchdogTimerCb, watchdog_interval,
+                         watchdog_interval);
+    assert(err == 0);
+    watchdog_timer_started_ = true;
+  }
+  int console_interval = agent_->console()->flush_interval_ms();
+  if (console_interval > 0) {
+    err = uv_timer_init(loop, &console_timer_);
+    assert(err == 0);
+    console_timer_.data = this;
+    err = uv_timer_start(&console_timer_, ConsoleTimerCb, console_interval,
+                         console_interval);
+    assert(err == 0);
+    console_timer_started_ = true;
+  }
+  return true;
+}
+
+void InspectorIo::DeleteServer() {
+  if (registry_slot_ >= 0) {
+    registry_->Remove(registry_slot_);
+    registry_slot_ = -1;
+  }
+  delegate_ = nullptr;
+  if (delete_server_ != nullptr)
+    delete_server_();
+  delete_server_ = nullptr;
 }
 
 template<typename Transport>
@@ -319,30 +524,74 @@ void InspectorIo::ThreadMain() {
   loop.data = nullptr;
   int err = uv_loop_init(&loop);
   assert(err == 0);
-  thread_req_.data = nullptr;
-  err = uv_async_init(&loop, &thread_req_, IoThreadAsyncCb<Transport>);
-  assert(err == 0);
-  std::string script_path = ScriptPath(&loop, script_name_);
-  InspectorIoDelegate delegate(this, script_path, script_name_,
-                               wait_for_connect_);
-  delegate_ = &delegate;
-  Transport server(&delegate, &loop, host_name_, port_, fopen(file_path_.c_str(), "w"));
-  TransportAndIo<Transport> queue_transport(&server, this);
-  thread_req_.data = &queue_transport;
-  if (!server.Start()) {
-    state_ = State::kError;  // Safe, main thread is waiting on semaphore
+  if (!StartServer<Transport>(&loop)) {
     assert(0 == CloseAsyncAndLoop(&thread_req_));
-    uv_sem_post(&thread_start_sem_);
+    DeleteServer();
+    ServerStarted(false);
     return;
   }
-  port_ = server.Port();  // Safe, main thread is waiting on semaphore.
-  if (!wait_for_connect_) {
-    uv_sem_post(&thread_start_sem_);
-  }
+  ServerStarted(true);
   uv_run(&loop, UV_RUN_DEFAULT);
   thread_req_.data = nullptr;
   assert(uv_loop_close(&loop) ==  0);
-  delegate_ = nullptr;
+  DeleteServer();
+}
+
+void InspectorIo::StartOnEmbedderLoop() {
+  if (!StartServer<InspectorSocketServer>(embedder_loop_)) {
+    uv_close(reinterpret_cast<uv_handle_t*>(&thread_req_),
+             EmbedderLoopStartFailed);
+    return;
+  }
+  ServerStarted(true);
+}
+
+// static
+void InspectorIo::EmbedderLoopStartFailed(uv_handle_t* handle) {
+  InspectorIo* io = ContainerOf(&InspectorIo::thread_req_,
+                                reinterpret_cast<uv_async_t*>(handle));
+  io->thread_req_.data = nullptr;
+  io->DeleteServer();
+  io->ServerStarted(false);
+}
+
+void InspectorIo::ServerStarted(bool listening) {
+  if (listening && registry_ != nullptr) {
+    std::vector<std::string> target_ids = delegate_->GetTargetIds();
+    registry_slot_ = registry_->Add(registry_label_, host_name_, port_,
+                                    target_ids.empty() ? "" : target_ids[0]);
+  }
+  if (async_start_) {
+    if (listening) {
+      state_ = State::kAccepting;
+      // Sends whatever Write() queued while the server was starting
+      int err = uv_async_send(&thread_req_);
+      assert(err == 0);
+    }
+    int port = port_;
+    agent_->PostToMainThread([listening, port](Agent* agent) {
+      agent->IoStarted(listening, port);
+    });
+    // For WaitForAsyncStart()
+    async_listening_ = listening;
+    uv_sem_post(&thread_start_sem_);
+    return;
+  }
+  // Safe, main thread is waiting on semaphore
+  if (!listening)
+    state_ = State::kError;
+  if (!listening || !wait_for_connect_)
+    uv_sem_post(&thread_start_sem_);
+}
+
+// static
+void InspectorIo::EmbedderLoopServerClosed(uv_handle_t* handle) {
+  InspectorIo* io = ContainerOf(&InspectorIo::thread_req_,
+                                reinterpret_cast<uv_async_t*>(handle));
+  io->thread_req_.data = nullptr;
+  io->DeleteServer();
+  // Wakes up Stop()
+  uv_sem_post(&io->thread_start_sem_);
 }
 
 template <typename ActionType>
@@ -368,16 +617,43 @@ void InspectorIo::SwapBehindLock(MessageQueue<ActionType>* vector1,
   //uv_mutex_unlock(&state_lock_);
 }
 
+void InspectorIo::ServerDone() {
+  // On the embedder's loop, the server goes once its handles are closed.
+  // Otherwise ThreadMain() takes care of it when the loop runs out.
+  uv_close(reinterpret_cast<uv_handle_t*>(&thread_req_),
+           embedder_loop_ != nullptr ? EmbedderLoopServerClosed : nullptr);
+  if (watchdog_timer_started_) {
+    uv_close(reinterpret_cast<uv_handle_t*>(&watchdog_timer_), nullptr);
+    watchdog_timer_started_ = false;
+  }
+  if (console_timer_started_) {
+    uv_close(reinterpret_cast<uv_handle_t*>(&console_timer_), nullptr);
+    console_timer_started_ = false;
+  }
+}
+
+// static
+void InspectorIo::WatchdogTimerCb(uv_timer_t* timer) {
+  InspectorIo* io = static_cast<InspectorIo*>(timer->data);
+  io->agent_->watchdog()->Check();
+}
+
+// static
+void InspectorIo::ConsoleTimerCb(uv_timer_t* timer) {
+  InspectorIo* io = static_cast<InspectorIo*>(timer->data);
+  io->agent_->FlushConsole();
+}
+
 void InspectorIo::PostIncomingMessage(InspectorAction action, int session_id,
                                       const std::string& message) {
     //fprintf(stderr, "%s %d appending action %d session %d and  message %s\n", __FILE__, __LINE__, action, session_id, message.c_str());
   if (AppendMessage(&incoming_message_queue_, action, session_id,
                     Utf8ToStringView(message))) {
-    Agent* agent = main_thread_req_->second;
-    platform_->CallOnForegroundThread(isolate_,
-                                      new DispatchMessagesTask(agent));
-    isolate_->RequestInterrupt(InterruptCallback, agent);
-    assert(0 == uv_async_send(&main_thread_req_->first));
+    agent_->WakeMainThread(
+        std::unique_ptr<Task>(new DispatchMessagesTask(agent_)),
+        InterruptCallback);
+    if (main_thread_req_ != nullptr)
+      assert(0 == uv_async_send(&main_thread_req_->first));
   }
   NotifyMessageReceived();
 }
@@ -386,12 +662,17 @@ std::vector<std::string> InspectorIo::GetTargetIds() const {
   return delegate_ ? delegate_->GetTargetIds() : std::vector<std::string>();
 }
 
-void InspectorIo::WaitForFrontendMessageWhilePaused() {
+void InspectorIo::WaitForFrontendMessageWhilePaused(int timeout_ms) {
   dispatching_messages_ = false;
   std::unique_lock<std::mutex> lck(state_lock_);
-  if (incoming_message_queue_.empty())
+  if (!incoming_message_queue_.empty())
+    return;
+  if (timeout_ms > 0) {
+    incoming_message_cond_.wait_for(lck,
+                                    std::chrono::milliseconds(timeout_ms));
+  } else {
     incoming_message_cond_.wait(lck);
-    //uv_cond_wait(&incoming_message_cond_, &state_lock_);
+  }
 }
 
 void InspectorIo::NotifyMessageReceived() {
@@ -441,6 +722,15 @@ void InspectorIo::DispatchMessages() {
       case InspectorAction::kSendMessage:
         agent_->Dispatch(message);
         break;
+      case InspectorAction::kDispatchDomainMessage: {
+        std::string request = StringViewToUtf8(message);
+        ProtocolEnvelope envelope;
+        ScanProtocolEnvelope(request.data(), request.size(), &envelope);
+        std::string response;
+        agent_->domains()->Dispatch(envelope, &response);
+        SendToFrontend(response);
+        break;
+      }
       }
     }
   } while (had_messages);
@@ -461,17 +751,45 @@ void InspectorIo::Write(TransportAction action, int session_id,
                         const StringView& inspector_message) {
   if (state_ == State::kShutDown)
     return;
+  // Messages for a session on a loop of its own skip the server loop.
+  int io_loop = session_io_loop_;
+  if (action == TransportAction::kSendMessage && io_loop > 0) {
+    if (AppendMessage(&session_message_queue_, action, session_id,
+                      StringBuffer::create(inspector_message))) {
+      post_to_session_loop_(io_loop);
+    }
+    return;
+  }
   AppendMessage(&outgoing_message_queue_, action, session_id,
                 StringBuffer::create(inspector_message));
+  // thread_req_ may not be initialized yet, ServerStarted() sends the
+  // message along once it is.
+  if (state_ == State::kNew)
+    return;
   int err = uv_async_send(&thread_req_);
   assert(0 == err);
 }
 
+void InspectorIo::SendToFrontend(const std::string& message) {
+  if (!IsConnected())
+    return;
+  // StringBuffer widens 8-bit views as Latin-1, so the message has to be
+  // decoded here to come out as the same UTF-8 on the IO thread.
+  Write(TransportAction::kSendMessage, session_id_,
+        Utf8ToStringView(message)->string());
+}
+
 InspectorIoDelegate::InspectorIoDelegate(InspectorIo* io,
                                          const std::string& script_path,
                                          const std::string& script_name,
-                                         bool wait)
+                                         bool wait,
+                                         InspectorStreams* streams,
+                                         InspectorDomains* domains,
+                                         InspectorScriptCache* script_cache)
                                          : io_(io),
+                                           streams_(streams),
+                                           domains_(domains),
+                                           script_cache_(script_cache),
                                            connected_(false),
                                            session_id_(0),
                                            script_name_(script_name),
@@ -482,9 +800,10 @@ InspectorIoDelegate::InspectorIoDelegate(InspectorIo* io,
 
 bool InspectorIoDelegate::StartSession(int session_id,
                                        const std::string& target_id) {
-  if (connected_)
+  if (connected_.exchange(true))
     return false;
-  connected_ = true;
+  // Called on the loop the session lives on
+  io_->session_io_loop_ = current_io_loop_();
   session_id_++;
   io_->PostIncomingMessage(InspectorAction::kStartSession, session_id, "");
   return true;
@@ -492,19 +811,44 @@ bool InspectorIoDelegate::StartSession(int session_id,
 
 void InspectorIoDelegate::MessageReceived(int session_id,
                                           const std::string& message) {
+  // Only the top-level fields are looked at, the params are skipped over.
+  ProtocolEnvelope envelope;
+  ScanProtocolEnvelope(message.data(), message.size(), &envelope);
   if (waiting_) {
-    if (message.find("\"Runtime.runIfWaitingForDebugger\"") !=
-        std::string::npos) {
-      waiting_ = false;
+    if (envelope.method == "Runtime.runIfWaitingForDebugger" &&
+        waiting_.exchange(false)) {
       io_->ResumeStartup();
     }
   }
-  io_->PostIncomingMessage(InspectorAction::kSendMessage, session_id,
-                           message);
+  // IO domain requests, and script sources V8 already sent, are served
+  // here, on the IO thread.
+  std::string response;
+  if (streams_->HandleProtocolMessage(envelope, &response) ||
+      script_cache_->HandleRequest(envelope, &response)) {
+    send_to_frontend_(session_id, response);
+    return;
+  }
+  InspectorAction action = InspectorAction::kSendMessage;
+  if (envelope.has_id) {
+    switch (domains_->RouteFor(envelope.method)) {
+    case InspectorDomains::Route::kV8:
+      break;
+    case InspectorDomains::Route::kIoThread:
+      domains_->Dispatch(envelope, &response);
+      send_to_frontend_(session_id, response);
+      return;
+    case InspectorDomains::Route::kMainThread:
+      action = InspectorAction::kDispatchDomainMessage;
+      break;
+    }
+  }
+  io_->PostIncomingMessage(action, session_id, message);
 }
 
 void InspectorIoDelegate::EndSession(int session_id) {
+  io_->session_io_loop_ = -1;
   connected_ = false;
+  script_cache_->SessionEnded();
   io_->PostIncomingMessage(InspectorAction::kEndSession, session_id, "");
 }
 
@@ -520,8 +864,17 @@ std::string InspectorIoDelegate::GetTargetUrl(const std::string& id) {
   return "file://" + script_path_;
 }
 
-bool IoSessionDelegate::WaitForFrontendMessageWhilePaused() {
-  io_->WaitForFrontendMessageWhilePaused();
+std::string InspectorIoDelegate::GetMetrics() {
+  return io_->agent()->GetMetrics();
+}
+
+int InspectorIoDelegate::OpenStreamFile(const std::string& handle,
+                                        int64_t* size) {
+  return streams_->DuplicateFile(handle, size);
+}
+
+bool IoSessionDelegate::WaitForFrontendMessageWhilePaused(int timeout_ms) {
+  io_->WaitForFrontendMessageWhilePaused(timeout_ms);
   return true;
 }
 
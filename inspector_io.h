@@ -28,7 +28,9 @@
 #include "uv.h"
 #include <v8.h>
 
+#include <atomic>
 #include <deque>
+#include <functional>
 #include <memory>
 #include <stddef.h>
 #include <condition_variable>
@@ -47,11 +49,14 @@ std::string FormatWsAddress(const std::string& host, int port,
                             bool include_protocol);
 
 class InspectorIoDelegate;
+class TargetRegistry;
 
 enum class InspectorAction {
   kStartSession,
   kEndSession,
-  kSendMessage
+  kSendMessage,
+  // A request for a domain handler that runs on the main thread
+  kDispatchDomainMessage
 };
 
 // kKill closes connections and stops the server, kStop only stops the server
@@ -64,12 +69,30 @@ enum class TransportAction {
 class InspectorIo {
  public:
   InspectorIo(Isolate* isolate, Platform* platform,
-              const std::string& path, std::string host_name, bool wait_for_connect, std::string file_path_, Agent *agent);
+              const std::string& path, std::string host_name, bool wait_for_connect, std::string file_path_, Agent *agent,
+              const ServerSocketOptions& server_options);
 
   ~InspectorIo();
+  // Runs the server on loop instead of on a thread of its own. post_to_loop
+  // must run a task on the thread that runs loop, which cannot be the
+  // calling thread. Call before Start().
+  void SetEmbedderLoop(uv_loop_t* loop,
+                       std::function<void(std::function<void()>)>
+                           post_to_loop);
+  // Lists the target in registry, under label, while the server listens.
+  // Call before Start().
+  void SetTargetRegistry(std::shared_ptr<TargetRegistry> registry,
+                         const std::string& label);
   // Start the inspector agent thread, waiting for it to initialize,
   // and waiting as well for a connection if wait_for_connect.
   bool Start();
+  // Starts the server without waiting for it. The outcome is reported to
+  // Agent::IoStarted() on the main thread, which calls AsyncStartDone().
+  void StartAsync();
+  void AsyncStartDone(bool listening);
+  bool async_start_pending() const { return async_start_pending_; }
+  // Blocks until the server is listening or has failed, and returns which.
+  bool WaitForAsyncStart();
   // Stop the inspector agent thread.
   void Stop();
 
@@ -81,14 +104,15 @@ class InspectorIo {
   // DispatchMessages() on the main thread.
   void PostIncomingMessage(InspectorAction action, int session_id,
                            const std::string& message);
+  // Queues a UTF-8 message for the connected session, if any. Thread-safe.
+  void SendToFrontend(const std::string& message);
   void ResumeStartup() {
     uv_sem_post(&thread_start_sem_);
   }
-  void ServerDone() {
-    uv_close(reinterpret_cast<uv_handle_t*>(&thread_req_), nullptr);
-  }
+  void ServerDone();
 
   int port() const { return port_; }
+  Agent* agent() const { return agent_; }
   std::string host() const { return host_name_; }
   std::vector<std::string> GetTargetIds() const;
 
@@ -114,10 +138,25 @@ class InspectorIo {
 
   // Runs a uv_loop_t
   template <typename Transport> void ThreadMain();
+  // Sets up the server on loop, from the thread that runs it. Returns false,
+  // leaving thread_req_ to be closed, if the server could not start.
+  template <typename Transport> bool StartServer(uv_loop_t* loop);
+  void DeleteServer();
+  void StartOnEmbedderLoop();
+  static void EmbedderLoopServerClosed(uv_handle_t* handle);
+  static void EmbedderLoopStartFailed(uv_handle_t* handle);
+  // Reports whether the server is listening, from the thread that runs it
+  void ServerStarted(bool listening);
   // Called by ThreadMain's loop when triggered by thread_req_, writes
   // messages from outgoing_message_queue to the InspectorSockerServer
   template <typename Transport> static void IoThreadAsyncCb(uv_async_t* async);
+  // Empties queue into transport, on the loop the messages are meant for
+  template <typename Transport>
+  void SendQueuedMessages(Transport* transport,
+                          MessageQueue<TransportAction>* queue);
 
+  static void WatchdogTimerCb(uv_timer_t* timer);
+  static void ConsoleTimerCb(uv_timer_t* timer);
   void SetConnected(bool connected);
   void DispatchMessages();
   // Write action to outgoing_message_queue, and wake the thread
@@ -134,7 +173,7 @@ class InspectorIo {
   void SwapBehindLock(MessageQueue<ActionType>* vector1,
                       MessageQueue<ActionType>* vector2);
   // Wait on incoming_message_cond_
-  void WaitForFrontendMessageWhilePaused();
+  void WaitForFrontendMessageWhilePaused(int timeout_ms);
   // Broadcast incoming_message_cond_
   void NotifyMessageReceived();
 
@@ -146,10 +185,37 @@ class InspectorIo {
   uv_sem_t thread_start_sem_;
 
   InspectorIoDelegate* delegate_;
-  State state_;
+  // Read by Write() on any thread while StartAsync() is pending
+  std::atomic<State> state_;
 
   // Attached to the uv_loop in ThreadMain()
   uv_async_t thread_req_;
+  // Runs the slow handler watchdog's checks, if it is enabled
+  uv_timer_t watchdog_timer_;
+  bool watchdog_timer_started_;
+  // Flushes the console pipeline, if it is enabled
+  uv_timer_t console_timer_;
+  bool console_timer_started_;
+  // Set when the server runs on the embedder's loop
+  uv_loop_t* embedder_loop_;
+  std::function<void(std::function<void()>)> post_to_embedder_loop_;
+  // Deletes the server StartServer() created
+  std::function<void()> delete_server_;
+  bool async_start_;
+  // Set by the server's thread before it posts thread_start_sem_
+  bool async_listening_;
+  // Main thread only
+  bool async_start_pending_;
+  bool async_start_waited_;
+  std::shared_ptr<TargetRegistry> registry_;
+  std::string registry_label_;
+  // The registry slot of the target, used from the server's thread
+  int registry_slot_;
+  // The IO loop of the connected session, set by the delegate on that loop.
+  // Above 0, Write() queues its messages in session_message_queue_ and wakes
+  // the loop through post_to_session_loop_, instead of the server loop.
+  std::atomic<int> session_io_loop_;
+  std::function<bool(int)> post_to_session_loop_;
   // Note that this will live while the async is being closed - likely, past
   // the parent object lifespan
   std::pair<uv_async_t, Agent*>* main_thread_req_;
@@ -164,10 +230,12 @@ class InspectorIo {
   //uv_mutex_t state_lock_;  // Locked before mutating either queue.
   MessageQueue<InspectorAction> incoming_message_queue_;
   MessageQueue<TransportAction> outgoing_message_queue_;
+  MessageQueue<TransportAction> session_message_queue_;
   MessageQueue<InspectorAction> dispatching_message_queue_;
 
   bool dispatching_messages_;
-  int session_id_;
+  // Read by SendToFrontend() off the main thread
+  std::atomic<int> session_id_;
 
   std::string script_name_;
   std::string script_path_;
@@ -176,14 +244,17 @@ class InspectorIo {
   Agent *agent_;
   const bool wait_for_connect_;
   int port_;
+  const ServerSocketOptions server_options_;
 
   friend class DispatchMessagesTask;
+  friend class InspectorIoDelegate;
   friend class IoSessionDelegate;
   friend void InterruptCallback(Isolate*, void* agent);
 };
 
 std::unique_ptr<v8_inspector::StringBuffer> Utf8ToStringView(
     const std::string& message);
+std::string StringViewToUtf8(const v8_inspector::StringView& view);
 
 }  // namespace inspector
 
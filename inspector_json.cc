@@ -0,0 +1,460 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#include "inspector_json.h"
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace inspector {
+
+namespace {
+
+inline bool IsSpace(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+const char* SkipSpace(const char* pos, const char* end) {
+  while (pos < end && IsSpace(*pos))
+    pos++;
+  return pos;
+}
+
+#if defined(__SSE2__)
+inline int CountTrailingZeros(unsigned mask) {
+  return __builtin_ctz(mask);
+}
+#endif
+
+// Returns the first '"' or '\\' at or after pos, or end.
+const char* FindQuoteOrEscape(const char* pos, const char* end) {
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  while (end - pos >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+    unsigned mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                     _mm_cmpeq_epi8(chunk, backslash)));
+    if (mask != 0)
+      return pos + CountTrailingZeros(mask);
+    pos += 16;
+  }
+#endif
+  while (pos < end && *pos != '"' && *pos != '\\')
+    pos++;
+  return pos;
+}
+
+// Returns the first '"', '{', '}', '[' or ']' at or after pos, or end.
+const char* FindStructural(const char* pos, const char* end) {
+#if defined(__SSE2__)
+  const __m128i quote = _mm_set1_epi8('"');
+  // '[' and ']' are 0x5B and 0x5D, '{' and '}' are 0x7B and 0x7D; clearing
+  // bit 5 maps the braces onto the brackets.
+  const __m128i case_bit = _mm_set1_epi8(0x20);
+  const __m128i open = _mm_set1_epi8('[');
+  const __m128i close = _mm_set1_epi8(']');
+  while (end - pos >= 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pos));
+    __m128i folded = _mm_andnot_si128(case_bit, chunk);
+    __m128i hits = _mm_or_si128(
+        _mm_cmpeq_epi8(chunk, quote),
+        _mm_or_si128(_mm_cmpeq_epi8(folded, open),
+                     _mm_cmpeq_epi8(folded, close)));
+    unsigned mask = _mm_movemask_epi8(hits);
+    if (mask != 0)
+      return pos + CountTrailingZeros(mask);
+    pos += 16;
+  }
+#endif
+  while (pos < end && *pos != '"' && *pos != '{' && *pos != '}' &&
+         *pos != '[' && *pos != ']') {
+    pos++;
+  }
+  return pos;
+}
+
+// pos is past the opening quote. Returns the position past the closing
+// quote, or nullptr.
+const char* SkipString(const char* pos, const char* end) {
+  for (;;) {
+    pos = FindQuoteOrEscape(pos, end);
+    if (pos >= end)
+      return nullptr;
+    if (*pos == '"')
+      return pos + 1;
+    pos += 2;  // The escaped character
+  }
+}
+
+// pos is at the opening '{' or '['. Returns the position past the matching
+// closing one, or nullptr.
+const char* SkipContainer(const char* pos, const char* end) {
+  int depth = 0;
+  for (;;) {
+    pos = FindStructural(pos, end);
+    if (pos >= end)
+      return nullptr;
+    switch (*pos) {
+      case '"':
+        pos = SkipString(pos + 1, end);
+        if (pos == nullptr)
+          return nullptr;
+        continue;
+      case '{':
+      case '[':
+        depth++;
+        break;
+      default:
+        if (--depth == 0)
+          return pos + 1;
+    }
+    pos++;
+  }
+}
+
+// Returns the position past the value at pos, or nullptr.
+const char* SkipValue(const char* pos, const char* end) {
+  if (pos >= end)
+    return nullptr;
+  switch (*pos) {
+    case '"':
+      return SkipString(pos + 1, end);
+    case '{':
+    case '[':
+      return SkipContainer(pos, end);
+    default: {
+      // Number, true, false or null
+      const char* start = pos;
+      while (pos < end && *pos != ',' && *pos != '}' && *pos != ']' &&
+             !IsSpace(*pos)) {
+        pos++;
+      }
+      return pos == start ? nullptr : pos;
+    }
+  }
+}
+
+int HexValue(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+bool ReadHex4(const char* pos, const char* end, uint32_t* out) {
+  if (end - pos < 4)
+    return false;
+  uint32_t value = 0;
+  for (int i = 0; i < 4; i++) {
+    int digit = HexValue(pos[i]);
+    if (digit < 0)
+      return false;
+    value = (value << 4) | digit;
+  }
+  *out = value;
+  return true;
+}
+
+void AppendUtf8(uint32_t code_point, std::string* out) {
+  if (code_point < 0x80) {
+    out->push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    out->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point < 0x10000) {
+    out->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else {
+    out->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+}
+
+}  // namespace
+
+JsonObjectScanner::JsonObjectScanner(const char* json, size_t length)
+    : pos_(json), end_(json + length), started_(false), error_(false),
+      key_(nullptr), key_length_(0), value_(nullptr), value_length_(0) {}
+
+bool JsonObjectScanner::Next() {
+  if (error_ || pos_ == nullptr)
+    return false;
+  const char* pos = SkipSpace(pos_, end_);
+  if (!started_) {
+    started_ = true;
+    if (pos >= end_ || *pos != '{') {
+      error_ = true;
+      return false;
+    }
+    pos = SkipSpace(pos + 1, end_);
+    if (pos < end_ && *pos == '}') {
+      pos_ = nullptr;
+      return false;
+    }
+  } else {
+    if (pos < end_ && *pos == '}') {
+      pos_ = nullptr;
+      return false;
+    }
+    if (pos >= end_ || *pos != ',') {
+      error_ = true;
+      return false;
+    }
+    pos = SkipSpace(pos + 1, end_);
+  }
+
+  if (pos >= end_ || *pos != '"') {
+    error_ = true;
+    return false;
+  }
+  const char* key_end = SkipString(pos + 1, end_);
+  if (key_end == nullptr) {
+    error_ = true;
+    return false;
+  }
+  key_ = pos + 1;
+  key_length_ = key_end - 1 - key_;
+  pos = SkipSpace(key_end, end_);
+  if (pos >= end_ || *pos != ':') {
+    error_ = true;
+    return false;
+  }
+  pos = SkipSpace(pos + 1, end_);
+  const char* value_end = SkipValue(pos, end_);
+  if (value_end == nullptr) {
+    error_ = true;
+    return false;
+  }
+  value_ = pos;
+  value_length_ = value_end - pos;
+  pos_ = value_end;
+  return true;
+}
+
+bool JsonObjectScanner::KeyIs(const char* name) const {
+  return strlen(name) == key_length_ &&
+         memcmp(name, key_, key_length_) == 0;
+}
+
+JsonArrayScanner::JsonArrayScanner(const char* json, size_t length)
+    : pos_(json), end_(json + length), started_(false), error_(false),
+      value_(nullptr), value_length_(0) {}
+
+bool JsonArrayScanner::Next() {
+  if (error_ || pos_ == nullptr)
+    return false;
+  const char* pos = SkipSpace(pos_, end_);
+  if (!started_) {
+    started_ = true;
+    if (pos >= end_ || *pos != '[') {
+      error_ = true;
+      return false;
+    }
+    pos = SkipSpace(pos + 1, end_);
+    if (pos < end_ && *pos == ']') {
+      pos_ = nullptr;
+      return false;
+    }
+  } else {
+    if (pos < end_ && *pos == ']') {
+      pos_ = nullptr;
+      return false;
+    }
+    if (pos >= end_ || *pos != ',') {
+      error_ = true;
+      return false;
+    }
+    pos = SkipSpace(pos + 1, end_);
+  }
+
+  const char* value_end = SkipValue(pos, end_);
+  if (value_end == nullptr) {
+    error_ = true;
+    return false;
+  }
+  value_ = pos;
+  value_length_ = value_end - pos;
+  pos_ = value_end;
+  return true;
+}
+
+bool JsonStringValue(const char* value, size_t length, std::string* out) {
+  if (length < 2 || value[0] != '"' || value[length - 1] != '"')
+    return false;
+  const char* pos = value + 1;
+  const char* end = value + length - 1;
+  out->clear();
+  for (;;) {
+    const char* next = FindQuoteOrEscape(pos, end);
+    out->append(pos, next - pos);
+    if (next >= end)
+      return true;
+    if (*next == '"' || next + 1 >= end)
+      return false;
+    pos = next + 2;
+    switch (next[1]) {
+      case '"': out->push_back('"'); break;
+      case '\\': out->push_back('\\'); break;
+      case '/': out->push_back('/'); break;
+      case 'b': out->push_back('\b'); break;
+      case 'f': out->push_back('\f'); break;
+      case 'n': out->push_back('\n'); break;
+      case 'r': out->push_back('\r'); break;
+      case 't': out->push_back('\t'); break;
+      case 'u': {
+        uint32_t code_point;
+        if (!ReadHex4(pos, end, &code_point))
+          return false;
+        pos += 4;
+        uint32_t low;
+        if (code_point >= 0xD800 && code_point < 0xDC00 &&
+            end - pos >= 6 && pos[0] == '\\' && pos[1] == 'u' &&
+            ReadHex4(pos + 2, end, &low) && low >= 0xDC00 && low < 0xE000) {
+          code_point = 0x10000 + ((code_point - 0xD800) << 10) +
+                       (low - 0xDC00);
+          pos += 6;
+        }
+        AppendUtf8(code_point, out);
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+}
+
+bool JsonIntegerValue(const char* value, size_t length, int64_t* out) {
+  const char* pos = value;
+  const char* end = value + length;
+  bool negative = pos < end && *pos == '-';
+  if (negative)
+    pos++;
+  if (pos >= end)
+    return false;
+  uint64_t magnitude = 0;
+  const uint64_t limit = negative ? UINT64_C(9223372036854775808)
+                                  : UINT64_C(9223372036854775807);
+  for (; pos < end; pos++) {
+    if (*pos < '0' || *pos > '9')
+      return false;
+    unsigned digit = *pos - '0';
+    if (magnitude > (limit - digit) / 10)
+      return false;
+    magnitude = magnitude * 10 + digit;
+  }
+  *out = negative ? static_cast<int64_t>(0 - magnitude)
+                  : static_cast<int64_t>(magnitude);
+  return true;
+}
+
+bool ScanProtocolEnvelope(const char* message, size_t length,
+                          ProtocolEnvelope* envelope) {
+  JsonObjectScanner scanner(message, length);
+  while (scanner.Next()) {
+    if (scanner.KeyIs("id")) {
+      envelope->has_id = JsonIntegerValue(scanner.value(),
+                                          scanner.value_length(),
+                                          &envelope->id);
+    } else if (scanner.KeyIs("method")) {
+      JsonStringValue(scanner.value(), scanner.value_length(),
+                      &envelope->method);
+    } else if (scanner.KeyIs("sessionId")) {
+      JsonStringValue(scanner.value(), scanner.value_length(),
+                      &envelope->session_id);
+    } else if (scanner.KeyIs("params")) {
+      envelope->params = scanner.value();
+      envelope->params_length = scanner.value_length();
+    }
+  }
+  return !scanner.error();
+}
+
+void AppendJsonString(std::string* out, const char* data, size_t len) {
+  static const char kHex[] = "0123456789abcdef";
+  out->push_back('"');
+  for (size_t i = 0; i < len; i++) {
+    const unsigned char c = static_cast<unsigned char>(data[i]);
+    switch (c) {
+      case '"': out->append("\\\""); break;
+      case '\\': out->append("\\\\"); break;
+      case '\b': out->append("\\b"); break;
+      case '\f': out->append("\\f"); break;
+      case '\n': out->append("\\n"); break;
+      case '\r': out->append("\\r"); break;
+      case '\t': out->append("\\t"); break;
+      default:
+        if (c < 0x20) {
+          out->append("\\u00");
+          out->push_back(kHex[c >> 4]);
+          out->push_back(kHex[c & 0xf]);
+        } else {
+          out->push_back(static_cast<char>(c));
+        }
+    }
+  }
+  out->push_back('"');
+}
+
+void AppendResponsePrefix(std::string* response, int64_t id) {
+  response->append("{\"id\":");
+  response->append(std::to_string(id));
+}
+
+void MakeErrorResponse(std::string* response, int64_t id, int code,
+                       const char* message) {
+  response->clear();
+  AppendResponsePrefix(response, id);
+  response->append(",\"error\":{\"code\":");
+  response->append(std::to_string(code));
+  response->append(",\"message\":");
+  AppendJsonString(response, message, strlen(message));
+  response->append("}}");
+}
+
+std::string JsonQuote(const std::string& value) {
+  std::string quoted;
+  AppendJsonString(&quoted, value.data(), value.size());
+  return quoted;
+}
+
+std::string JsonRawMember(const std::string& object, const char* name,
+                          const char* fallback) {
+  JsonObjectScanner scanner(object.data(), object.size());
+  while (scanner.Next()) {
+    if (scanner.KeyIs(name))
+      return std::string(scanner.value(), scanner.value_length());
+  }
+  return fallback;
+}
+
+}  // namespace inspector
@@ -0,0 +1,131 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#ifndef SRC_INSPECTOR_JSON_H_
+#define SRC_INSPECTOR_JSON_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace inspector {
+
+// Walks the members of one JSON object without parsing their values. Nested
+// objects, arrays and strings are skipped over, 16 bytes at a time where
+// SSE2 is available. Values are only validated as far as needed to find
+// where they end.
+class JsonObjectScanner {
+ public:
+  JsonObjectScanner(const char* json, size_t length);
+
+  // Moves to the next member. Returns false at the end of the object, or if
+  // the input turns out not to be a JSON object (see error()).
+  bool Next();
+  bool error() const { return error_; }
+
+  // Whether the current member's key is name. Keys are compared raw, with
+  // any escapes left as they are.
+  bool KeyIs(const char* name) const;
+  // The current member's value, as it appears in the input
+  const char* value() const { return value_; }
+  size_t value_length() const { return value_length_; }
+
+ private:
+  const char* pos_;
+  const char* const end_;
+  bool started_;
+  bool error_;
+  const char* key_;
+  size_t key_length_;
+  const char* value_;
+  size_t value_length_;
+};
+
+// Walks the elements of one JSON array, the same way JsonObjectScanner walks
+// object members.
+class JsonArrayScanner {
+ public:
+  JsonArrayScanner(const char* json, size_t length);
+
+  bool Next();
+  bool error() const { return error_; }
+
+  const char* value() const { return value_; }
+  size_t value_length() const { return value_length_; }
+
+ private:
+  const char* pos_;
+  const char* const end_;
+  bool started_;
+  bool error_;
+  const char* value_;
+  size_t value_length_;
+};
+
+// Decodes a JSON string value, quotes included. Returns false if value is
+// not a string.
+bool JsonStringValue(const char* value, size_t length, std::string* out);
+// Returns false if value is not an integer that fits in 64 bits.
+bool JsonIntegerValue(const char* value, size_t length, int64_t* out);
+
+// The top-level fields of a protocol message that routing needs.
+struct ProtocolEnvelope {
+  ProtocolEnvelope() : has_id(false), id(0), params(nullptr),
+                       params_length(0) { }
+  bool has_id;
+  int64_t id;
+  std::string method;
+  std::string session_id;
+  // The "params" value as it appears in the message, or nullptr
+  const char* params;
+  size_t params_length;
+};
+
+// Fills envelope from the top-level members of message. Returns false if the
+// message is not a JSON object.
+bool ScanProtocolEnvelope(const char* message, size_t length,
+                          ProtocolEnvelope* envelope);
+
+// JSON-RPC error codes used in protocol responses
+const int kProtocolMethodNotFound = -32601;
+const int kProtocolInvalidParams = -32602;
+const int kProtocolServerError = -32000;
+
+// Appends data, which is UTF-8, as a quoted JSON string.
+void AppendJsonString(std::string* out, const char* data, size_t len);
+// value as a quoted JSON string
+std::string JsonQuote(const std::string& value);
+// The value of member name in the JSON object, as it appears there, or
+// fallback.
+std::string JsonRawMember(const std::string& object, const char* name,
+                          const char* fallback);
+// Appends the start of a response to request id, up to its "result" or
+// "error" member.
+void AppendResponsePrefix(std::string* response, int64_t id);
+// Replaces *response with an error response to request id.
+void MakeErrorResponse(std::string* response, int64_t id, int code,
+                       const char* message);
+
+}  // namespace inspector
+
+#endif  // SRC_INSPECTOR_JSON_H_
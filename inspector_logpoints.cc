@@ -0,0 +1,238 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#include "inspector_logpoints.h"
+
+#include "inspector_json.h"
+#include "inspector_snapshots.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace inspector {
+
+namespace {
+
+// 10482 as "10,482"
+std::string WithSeparators(uint64_t value) {
+  std::string digits = std::to_string(value);
+  std::string result;
+  for (size_t i = 0; i < digits.size(); i++) {
+    if (i > 0 && (digits.size() - i) % 3 == 0)
+      result.push_back(',');
+    result.push_back(digits[i]);
+  }
+  return result;
+}
+
+int64_t NowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+}  // namespace
+
+Logpoints::Logpoints(SessionGetter session, Sink sink)
+    : session_(session), sink_(sink), file_(nullptr), next_index_(1) { }
+
+Logpoints::~Logpoints() {
+  if (file_ != nullptr)
+    fclose(file_);
+}
+
+std::string Logpoints::Set(const std::string& url, int line_number,
+                           int column_number, const std::string& expression,
+                           double max_per_second, int burst) {
+  SnapshotBreakpoints* session = session_();
+  if (session == nullptr)
+    return std::string();
+  // Hits are handled from the pause path, before the frontend hears of
+  // the pause, so nothing is installed where the application can see it.
+  session->set_hit_handler(
+      [this](const std::string& breakpoint_id,
+             const std::string& call_frame_id) {
+        return HandleHit(breakpoint_id, call_frame_id);
+      });
+  int index = next_index_++;
+  std::string result = session->Call(
+      "Debugger.setBreakpointByUrl",
+      "{\"url\":" + JsonQuote(url) +
+      ",\"lineNumber\":" + std::to_string(line_number) +
+      ",\"columnNumber\":" + std::to_string(column_number) + "}");
+  std::string raw_id = JsonRawMember(result, "breakpointId", "");
+  std::string id;
+  if (!JsonStringValue(raw_id.data(), raw_id.size(), &id))
+    return std::string();
+
+  std::lock_guard<std::mutex> lock(lock_);
+  logpoints_.emplace(index, Logpoint(id, expression,
+                                     std::max(max_per_second, 0.0),
+                                     std::max(burst, 1)));
+  return id;
+}
+
+void Logpoints::Remove(const std::string& id) {
+  uint64_t unreported = 0;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = std::find_if(logpoints_.begin(), logpoints_.end(),
+                           [&id](const std::pair<const int, Logpoint>& entry) {
+                             return entry.second.breakpoint_id == id;
+                           });
+    if (it == logpoints_.end())
+      return;
+    unreported = it->second.unreported;
+    logpoints_.erase(it);
+  }
+  if (unreported > 0) {
+    Write(id, "Logpoint.suppressed",
+          "{\"breakpointId\":" + JsonQuote(id) +
+          ",\"count\":" + std::to_string(unreported) + "}",
+          "suppressed " + WithSeparators(unreported) + " messages");
+  }
+  SnapshotBreakpoints* session = session_();
+  if (session != nullptr) {
+    session->Call("Debugger.removeBreakpoint",
+                  "{\"breakpointId\":" + JsonQuote(id) + "}");
+  }
+}
+
+bool Logpoints::SetLogFile(const std::string& path) {
+  FILE* file = nullptr;
+  if (!path.empty()) {
+    file = fopen(path.c_str(), "a");
+    if (file == nullptr)
+      return false;
+  }
+  if (file_ != nullptr)
+    fclose(file_);
+  file_ = file;
+  return true;
+}
+
+std::string Logpoints::StatsJson() {
+  std::lock_guard<std::mutex> lock(lock_);
+  std::string json = "[";
+  for (const auto& entry : logpoints_) {
+    const Logpoint& logpoint = entry.second;
+    if (json.size() > 1)
+      json.push_back(',');
+    json += "{\"breakpointId\":" + JsonQuote(logpoint.breakpoint_id) +
+            ",\"hits\":" + std::to_string(logpoint.hits) +
+            ",\"logged\":" + std::to_string(logpoint.logged) +
+            ",\"suppressed\":" + std::to_string(logpoint.suppressed) + "}";
+  }
+  json.push_back(']');
+  return json;
+}
+
+bool Logpoints::HandleHit(const std::string& breakpoint_id,
+                          const std::string& call_frame_id) {
+  int index;
+  std::string expression;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = std::find_if(logpoints_.begin(), logpoints_.end(),
+                           [&breakpoint_id](
+                               const std::pair<const int, Logpoint>& entry) {
+                             return entry.second.breakpoint_id ==
+                                    breakpoint_id;
+                           });
+    if (it == logpoints_.end())
+      return false;
+    index = it->first;
+    expression = it->second.expression;
+  }
+  SnapshotBreakpoints* session = session_();
+  if (!Hit(index) || session == nullptr || call_frame_id.empty())
+    return true;
+  std::string result = session->Call(
+      "Debugger.evaluateOnCallFrame",
+      "{\"callFrameId\":" + call_frame_id +
+      ",\"expression\":" + JsonQuote("String(" + expression + ")") +
+      ",\"silent\":true,\"returnByValue\":true}");
+  if (!JsonRawMember(result, "exceptionDetails", "").empty())
+    return true;
+  std::string value = JsonRawMember(JsonRawMember(result, "result", "{}"),
+                                    "value", "");
+  std::string message;
+  if (JsonStringValue(value.data(), value.size(), &message))
+    Log(index, message);
+  return true;
+}
+
+bool Logpoints::Hit(int index) {
+  std::lock_guard<std::mutex> lock(lock_);
+  auto it = logpoints_.find(index);
+  if (it == logpoints_.end())
+    return false;
+  Logpoint& logpoint = it->second;
+  logpoint.hits++;
+  if (logpoint.bucket.Take(logpoint.max_per_second, logpoint.burst))
+    return true;
+  logpoint.suppressed++;
+  logpoint.unreported++;
+  return false;
+}
+
+void Logpoints::Log(int index, const std::string& message) {
+  std::string id;
+  uint64_t hit_count;
+  uint64_t unreported;
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto it = logpoints_.find(index);
+    if (it == logpoints_.end())
+      return;
+    Logpoint& logpoint = it->second;
+    logpoint.logged++;
+    id = logpoint.breakpoint_id;
+    hit_count = logpoint.hits;
+    unreported = logpoint.unreported;
+    logpoint.unreported = 0;
+  }
+  std::string quoted_id = JsonQuote(id);
+  if (unreported > 0) {
+    Write(id, "Logpoint.suppressed",
+          "{\"breakpointId\":" + quoted_id +
+          ",\"count\":" + std::to_string(unreported) + "}",
+          "suppressed " + WithSeparators(unreported) + " messages");
+  }
+  Write(id, "Logpoint.message",
+        "{\"breakpointId\":" + quoted_id +
+        ",\"hitCount\":" + std::to_string(hit_count) +
+        ",\"message\":" + JsonQuote(message) + "}",
+        message);
+}
+
+void Logpoints::Write(const std::string& id, const std::string& method,
+                      const std::string& params, const std::string& line) {
+  if (file_ == nullptr) {
+    sink_(method, params);
+    return;
+  }
+  fprintf(file_, "%lld %s %s\n", static_cast<long long>(NowMs()), id.c_str(),
+          line.c_str());
+  fflush(file_);
+}
+
+}  // namespace inspector
@@ -0,0 +1,115 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#ifndef SRC_INSPECTOR_LOGPOINTS_H_
+#define SRC_INSPECTOR_LOGPOINTS_H_
+
+#include "inspector_util.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace inspector {
+
+class SnapshotBreakpoints;
+
+// Breakpoints that log a message instead of pausing. Each has a hit counter
+// and a token bucket: the message expression is only evaluated while there
+// are tokens left, and what gets dropped is reported as a count with the
+// next message that gets through. Hits are taken from the pause path of
+// the session, which evaluates the expression on the paused frame and
+// resumes without the frontend seeing the pause. Main thread only, except
+// for StatsJson().
+class Logpoints {
+ public:
+  // Sends a notification to the frontend
+  using Sink = std::function<void(const std::string& method,
+                                  const std::string& params)>;
+  // Returns the session breakpoints are set in, or nullptr
+  using SessionGetter = std::function<SnapshotBreakpoints*()>;
+
+  Logpoints(SessionGetter session, Sink sink);
+  ~Logpoints();
+
+  // Logs the value of expression, converted to a string, each time the
+  // location is hit. At most burst messages go out back to back, and
+  // max_per_second on average after that; zero means no limit. Returns the
+  // breakpoint id, or an empty string.
+  std::string Set(const std::string& url, int line_number, int column_number,
+                  const std::string& expression, double max_per_second,
+                  int burst);
+  void Remove(const std::string& id);
+  // Appends messages to path instead of sending them to the frontend. An
+  // empty path goes back to the frontend. Returns false if path could not
+  // be opened.
+  bool SetLogFile(const std::string& path);
+
+  // Hits, messages logged and messages suppressed, per logpoint, as a JSON
+  // array. Thread-safe.
+  std::string StatsJson();
+
+ private:
+  struct Logpoint {
+    Logpoint(const std::string& breakpoint_id, const std::string& expression,
+             double max_per_second, double burst)
+        : breakpoint_id(breakpoint_id), expression(expression),
+          max_per_second(max_per_second), burst(burst), bucket(burst),
+          hits(0), logged(0), suppressed(0), unreported(0) { }
+    std::string breakpoint_id;
+    std::string expression;
+    double max_per_second;
+    double burst;
+    TokenBucket bucket;
+    uint64_t hits;
+    uint64_t logged;
+    uint64_t suppressed;
+    // Suppressed since the last message that got through
+    uint64_t unreported;
+  };
+
+  // Logs a hit of breakpoint_id if it is a logpoint. Returns false if it
+  // is not one.
+  bool HandleHit(const std::string& breakpoint_id,
+                 const std::string& call_frame_id);
+  // Counts a hit, and takes a token if there is one
+  bool Hit(int index);
+  void Log(int index, const std::string& message);
+  void Write(const std::string& id, const std::string& method,
+             const std::string& params, const std::string& line);
+
+  const SessionGetter session_;
+  const Sink sink_;
+  FILE* file_;
+  int next_index_;
+  // Guards logpoints_, which StatsJson() reads from other threads
+  std::mutex lock_;
+  std::map<int, Logpoint> logpoints_;
+};
+
+}  // namespace inspector
+
+#endif  // SRC_INSPECTOR_LOGPOINTS_H_
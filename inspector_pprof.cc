@@ -0,0 +1,367 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#include "inspector_pprof.h"
+
+#include "inspector_util.h"
+#include "zlib.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <thread>
+
+namespace inspector {
+
+namespace {
+
+// Field numbers from pprof's profile.proto
+enum ProfileField {
+  kProfileSampleType = 1,
+  kProfileSample = 2,
+  kProfileLocation = 4,
+  kProfileFunction = 5,
+  kProfileStringTable = 6,
+  kProfileTimeNanos = 9,
+  kProfileDurationNanos = 10,
+  kProfilePeriodType = 11,
+  kProfilePeriod = 12
+};
+enum ValueTypeField { kValueTypeType = 1, kValueTypeUnit = 2 };
+enum SampleField {
+  kSampleLocationId = 1,
+  kSampleValue = 2,
+  kSampleLabel = 3
+};
+enum LabelField { kLabelKey = 1, kLabelStr = 2 };
+enum LocationField { kLocationId = 1, kLocationLine = 4 };
+enum LineField { kLineFunctionId = 1, kLineLine = 2 };
+enum FunctionField {
+  kFunctionId = 1,
+  kFunctionName = 2,
+  kFunctionSystemName = 3,
+  kFunctionFilename = 4,
+  kFunctionStartLine = 5
+};
+
+const int kWireVarint = 0;
+const int kWireLengthDelimited = 2;
+
+// Just enough of the protobuf wire format to write a profile.
+class ProtoWriter {
+ public:
+  void Varint(uint64_t value) {
+    while (value >= 0x80) {
+      out_.push_back(static_cast<char>(value | 0x80));
+      value >>= 7;
+    }
+    out_.push_back(static_cast<char>(value));
+  }
+
+  void Int(int field, uint64_t value) {
+    if (value == 0)
+      return;
+    Varint((field << 3) | kWireVarint);
+    Varint(value);
+  }
+
+  void Bytes(int field, const std::string& data) {
+    Varint((field << 3) | kWireLengthDelimited);
+    Varint(data.size());
+    out_.append(data);
+  }
+
+  void Message(int field, const ProtoWriter& message) {
+    Bytes(field, message.out_);
+  }
+
+  void Packed(int field, const std::vector<uint64_t>& values) {
+    ProtoWriter packed;
+    for (uint64_t value : values)
+      packed.Varint(value);
+    Bytes(field, packed.out_);
+  }
+
+  const std::string& data() const { return out_; }
+
+ private:
+  std::string out_;
+};
+
+class StringTable {
+ public:
+  StringTable() {
+    Index("");
+  }
+
+  uint64_t Index(const std::string& value) {
+    auto it = indexes_.find(value);
+    if (it != indexes_.end())
+      return it->second;
+    uint64_t index = strings_.size();
+    indexes_[value] = index;
+    strings_.push_back(value);
+    return index;
+  }
+
+  void WriteTo(ProtoWriter* profile) const {
+    for (const std::string& value : strings_)
+      profile->Bytes(kProfileStringTable, value);
+  }
+
+ private:
+  std::map<std::string, uint64_t> indexes_;
+  std::vector<std::string> strings_;
+};
+
+ProtoWriter ValueTypeMessage(const SampledProfile::ValueType& value_type,
+                             StringTable* strings) {
+  ProtoWriter message;
+  message.Int(kValueTypeType, strings->Index(value_type.type));
+  message.Int(kValueTypeUnit, strings->Index(value_type.unit));
+  return message;
+}
+
+std::string FunctionName(const SampledProfile::Frame& frame) {
+  return frame.function_name.empty() ? "(anonymous)" : frame.function_name;
+}
+
+std::string Gzip(const std::string& data) {
+  z_stream strm;
+  strm.zalloc = Z_NULL;
+  strm.zfree = Z_NULL;
+  strm.opaque = Z_NULL;
+  // 16 selects the gzip wrapper
+  int err = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                         16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+  if (err != Z_OK)
+    return std::string();
+  std::string out(deflateBound(&strm, data.size()), '\0');
+  strm.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  strm.avail_in = data.size();
+  strm.next_out = reinterpret_cast<Bytef*>(&out[0]);
+  strm.avail_out = out.size();
+  err = deflate(&strm, Z_FINISH);
+  out.resize(strm.total_out);
+  deflateEnd(&strm);
+  return err == Z_STREAM_END ? out : std::string();
+}
+
+}  // namespace
+
+SampledProfile::SampledProfile(const std::vector<ValueType>& sample_types,
+                               const ValueType& period_type, int64_t period)
+                               : sample_types_(sample_types),
+                                 period_type_(period_type), period_(period),
+                                 time_nanos_(0), duration_nanos_(0) { }
+
+size_t SampledProfile::AddFrame(const std::string& function_name,
+                                const std::string& url, int line,
+                                int column) {
+  auto key = std::make_tuple(function_name, url, line, column);
+  auto it = frame_index_.find(key);
+  if (it != frame_index_.end())
+    return it->second;
+  size_t index = frames_.size();
+  frames_.push_back(Frame{function_name, url, line, column});
+  frame_index_[key] = index;
+  return index;
+}
+
+void SampledProfile::AddSample(const std::vector<size_t>& stack,
+                               const std::vector<int64_t>& values) {
+  samples_.push_back(Sample{stack, values, {}});
+}
+
+void SampledProfile::Merge(const SampledProfile& other,
+                           const std::string& label_key,
+                           const std::string& label_value) {
+  std::vector<size_t> frame_map;
+  for (const Frame& frame : other.frames_) {
+    frame_map.push_back(AddFrame(frame.function_name, frame.url, frame.line,
+                                 frame.column));
+  }
+  for (const Sample& sample : other.samples_) {
+    Sample merged{{}, sample.values, sample.labels};
+    for (size_t frame : sample.stack)
+      merged.stack.push_back(frame_map[frame]);
+    merged.labels.push_back(std::make_pair(label_key, label_value));
+    samples_.push_back(std::move(merged));
+  }
+  if (other.time_nanos_ != 0) {
+    int64_t end = std::max(time_nanos_ + duration_nanos_,
+                           other.time_nanos_ + other.duration_nanos_);
+    if (time_nanos_ == 0 || other.time_nanos_ < time_nanos_)
+      time_nanos_ = other.time_nanos_;
+    duration_nanos_ = end - time_nanos_;
+  }
+}
+
+std::string SampledProfile::ToPprof() const {
+  StringTable strings;
+  ProtoWriter profile;
+  for (const ValueType& sample_type : sample_types_) {
+    profile.Message(kProfileSampleType,
+                    ValueTypeMessage(sample_type, &strings));
+  }
+
+  for (const Sample& sample : samples_) {
+    ProtoWriter message;
+    std::vector<uint64_t> location_ids;
+    for (size_t frame : sample.stack)
+      location_ids.push_back(frame + 1);
+    message.Packed(kSampleLocationId, location_ids);
+    std::vector<uint64_t> values(sample.values.begin(), sample.values.end());
+    message.Packed(kSampleValue, values);
+    for (const auto& label : sample.labels) {
+      ProtoWriter label_message;
+      label_message.Int(kLabelKey, strings.Index(label.first));
+      label_message.Int(kLabelStr, strings.Index(label.second));
+      message.Message(kSampleLabel, label_message);
+    }
+    profile.Message(kProfileSample, message);
+  }
+
+  // Each frame is a location, frames of the same function share it. A
+  // frame's line and column are where its function starts, which tells
+  // apart anonymous or same-named functions of a script.
+  std::map<std::tuple<std::string, std::string, int, int>, uint64_t>
+      function_ids;
+  for (size_t i = 0; i < frames_.size(); i++) {
+    const Frame& frame = frames_[i];
+    auto function_key = std::make_tuple(frame.function_name, frame.url,
+                                        frame.line, frame.column);
+    auto it = function_ids.find(function_key);
+    uint64_t function_id;
+    if (it == function_ids.end()) {
+      function_id = function_ids.size() + 1;
+      function_ids[function_key] = function_id;
+      ProtoWriter function;
+      function.Int(kFunctionId, function_id);
+      uint64_t name = strings.Index(FunctionName(frame));
+      function.Int(kFunctionName, name);
+      function.Int(kFunctionSystemName, name);
+      function.Int(kFunctionFilename, strings.Index(frame.url));
+      function.Int(kFunctionStartLine, frame.line);
+      profile.Message(kProfileFunction, function);
+    } else {
+      function_id = it->second;
+    }
+    ProtoWriter line;
+    line.Int(kLineFunctionId, function_id);
+    line.Int(kLineLine, frame.line);
+    ProtoWriter location;
+    location.Int(kLocationId, i + 1);
+    location.Message(kLocationLine, line);
+    profile.Message(kProfileLocation, location);
+  }
+
+  profile.Int(kProfileTimeNanos, time_nanos_);
+  profile.Int(kProfileDurationNanos, duration_nanos_);
+  profile.Message(kProfilePeriodType,
+                  ValueTypeMessage(period_type_, &strings));
+  profile.Int(kProfilePeriod, period_);
+  strings.WriteTo(&profile);
+  return Gzip(profile.data());
+}
+
+std::string SampledProfile::ToFolded(size_t value_index) const {
+  std::vector<std::string> names;
+  for (const Frame& frame : frames_) {
+    std::string name = FunctionName(frame);
+    if (!frame.url.empty()) {
+      name += " (" + frame.url;
+      if (frame.line > 0)
+        name += ":" + std::to_string(frame.line);
+      name += ")";
+    }
+    for (char& c : name) {
+      if (c == ';' || c == '\n')
+        c = '_';
+    }
+    names.push_back(name);
+  }
+
+  // Samples with the same labels and stack are merged
+  std::map<std::pair<std::vector<std::string>, std::vector<size_t>>, int64_t>
+      stacks;
+  for (const Sample& sample : samples_) {
+    if (value_index >= sample.values.size() || sample.values[value_index] == 0)
+      continue;
+    std::vector<std::string> labels;
+    for (auto label = sample.labels.rbegin(); label != sample.labels.rend();
+         ++label) {
+      labels.push_back(label->second);
+    }
+    stacks[std::make_pair(labels, sample.stack)] += sample.values[value_index];
+  }
+  std::string folded;
+  for (const auto& stack : stacks) {
+    bool first = true;
+    for (const std::string& label : stack.first.first) {
+      if (!first)
+        folded.push_back(';');
+      folded.append(label);
+      first = false;
+    }
+    const std::vector<size_t>& frames = stack.first.second;
+    for (auto frame = frames.rbegin(); frame != frames.rend(); ++frame) {
+      if (!first)
+        folded.push_back(';');
+      folded.append(names[*frame]);
+      first = false;
+    }
+    folded.push_back(' ');
+    folded.append(std::to_string(stack.second));
+    folded.push_back('\n');
+  }
+  return folded;
+}
+
+bool WriteProfile(const SampledProfile& profile, size_t folded_value_index,
+                  const std::string& path_prefix) {
+  bool ok = true;
+  std::string pprof = profile.ToPprof();
+  if (pprof.empty() || !WriteFileAtomically(path_prefix + ".pb.gz", pprof)) {
+    fprintf(stderr, "Could not write %s.pb.gz\n", path_prefix.c_str());
+    ok = false;
+  }
+  if (!WriteFileAtomically(path_prefix + ".folded",
+                 profile.ToFolded(folded_value_index))) {
+    fprintf(stderr, "Could not write %s.folded\n", path_prefix.c_str());
+    ok = false;
+  }
+  return ok;
+}
+
+void WriteProfileInBackground(std::unique_ptr<SampledProfile> profile,
+                              size_t folded_value_index,
+                              const std::string& path_prefix) {
+  SampledProfile* raw = profile.release();
+  std::thread([raw, folded_value_index, path_prefix]() {
+    std::unique_ptr<SampledProfile> profile(raw);
+    WriteProfile(*profile, folded_value_index, path_prefix);
+  }).detach();
+}
+
+}  // namespace inspector
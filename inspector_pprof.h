@@ -0,0 +1,117 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#ifndef SRC_INSPECTOR_PPROF_H_
+#define SRC_INSPECTOR_PPROF_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace inspector {
+
+// A profile copied out of V8 on the isolate thread, so that it can be
+// encoded and written anywhere else.
+class SampledProfile {
+ public:
+  struct ValueType {
+    std::string type;
+    std::string unit;
+  };
+
+  struct Frame {
+    std::string function_name;
+    std::string url;
+    // 1-based, or 0 if unknown
+    int line;
+    int column;
+  };
+
+  struct Sample {
+    // Indexes into frames(), leaf first
+    std::vector<size_t> stack;
+    // One per sample type
+    std::vector<int64_t> values;
+    // Key and value pairs
+    std::vector<std::pair<std::string, std::string>> labels;
+  };
+
+  SampledProfile(const std::vector<ValueType>& sample_types,
+                 const ValueType& period_type, int64_t period);
+
+  // Returns the index of the frame, adding it if it is new.
+  size_t AddFrame(const std::string& function_name, const std::string& url,
+                  int line, int column);
+  void AddSample(const std::vector<size_t>& stack,
+                 const std::vector<int64_t>& values);
+  // Adds the samples of other, which has the same sample types, labeled
+  // label_key = label_value. Frames of the same function are shared.
+  void Merge(const SampledProfile& other, const std::string& label_key,
+             const std::string& label_value);
+  void set_time(int64_t time_nanos, int64_t duration_nanos) {
+    time_nanos_ = time_nanos;
+    duration_nanos_ = duration_nanos;
+  }
+
+  const std::vector<ValueType>& sample_types() const { return sample_types_; }
+  const ValueType& period_type() const { return period_type_; }
+  int64_t period() const { return period_; }
+  const std::vector<Frame>& frames() const { return frames_; }
+  const std::vector<Sample>& samples() const { return samples_; }
+
+  // The profile.proto message pprof reads, gzip compressed
+  std::string ToPprof() const;
+  // One "root;...;leaf value" line per distinct stack, as read by
+  // flamegraph.pl, using the value of sample type value_index. Label values
+  // become the outermost frames.
+  std::string ToFolded(size_t value_index) const;
+
+ private:
+  std::vector<ValueType> sample_types_;
+  ValueType period_type_;
+  int64_t period_;
+  int64_t time_nanos_;
+  int64_t duration_nanos_;
+  std::vector<Frame> frames_;
+  std::map<std::tuple<std::string, std::string, int, int>, size_t>
+      frame_index_;
+  std::vector<Sample> samples_;
+};
+
+// Writes profile to path_prefix + ".pb.gz" and, folded by the value of
+// sample type folded_value_index, to path_prefix + ".folded". Each file
+// appears under its name once complete.
+bool WriteProfile(const SampledProfile& profile, size_t folded_value_index,
+                  const std::string& path_prefix);
+// Calls WriteProfile() on a background thread.
+void WriteProfileInBackground(std::unique_ptr<SampledProfile> profile,
+                              size_t folded_value_index,
+                              const std::string& path_prefix);
+
+}  // namespace inspector
+
+#endif  // SRC_INSPECTOR_PPROF_H_
@@ -0,0 +1,124 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#include "inspector_profile_coordinator.h"
+
+#include "inspector_agent.h"
+#include "inspector_pprof.h"
+
+#include <stdio.h>
+
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace inspector {
+
+// The profiles of one StopCpuProfiling(), as they come in from each agent's
+// main thread.
+class ProfileCoordinator::Collection
+    : public std::enable_shared_from_this<Collection> {
+ public:
+  Collection(const std::map<Agent*, std::string>& agents,
+             const std::string& path_prefix) : outstanding_(agents),
+                                               path_prefix_(path_prefix) { }
+
+  // profile is nullptr if the agent has none, or is going away. Only the
+  // first call for each agent counts.
+  void Add(Agent* agent, std::unique_ptr<SampledProfile> profile) {
+    bool done;
+    {
+      std::unique_lock<std::mutex> lock(lock_);
+      auto it = outstanding_.find(agent);
+      if (it == outstanding_.end())
+        return;
+      if (profile != nullptr)
+        profiles_.push_back(std::make_pair(it->second, std::move(profile)));
+      outstanding_.erase(it);
+      done = outstanding_.empty();
+    }
+    if (done) {
+      std::shared_ptr<Collection> self = shared_from_this();
+      std::thread([self]() { self->Write(); }).detach();
+    }
+  }
+
+ private:
+  void Write() {
+    if (profiles_.empty()) {
+      fprintf(stderr, "No CPU profiles to write to %s\n",
+              path_prefix_.c_str());
+      return;
+    }
+    const SampledProfile& first = *profiles_.front().second;
+    SampledProfile merged(first.sample_types(), first.period_type(),
+                          first.period());
+    for (const auto& profile : profiles_)
+      merged.Merge(*profile.second, "isolate", profile.first);
+    WriteProfile(merged, 0, path_prefix_);
+  }
+
+  std::mutex lock_;
+  // Agents still to hand in their profile, with their labels
+  std::map<Agent*, std::string> outstanding_;
+  std::vector<std::pair<std::string, std::unique_ptr<SampledProfile>>>
+      profiles_;
+  const std::string path_prefix_;
+};
+
+void ProfileCoordinator::Register(Agent* agent, const std::string& label) {
+  std::unique_lock<std::mutex> lock(lock_);
+  agents_[agent] = label;
+}
+
+void ProfileCoordinator::Unregister(Agent* agent) {
+  std::unique_lock<std::mutex> lock(lock_);
+  agents_.erase(agent);
+  if (collection_ != nullptr)
+    collection_->Add(agent, nullptr);
+}
+
+void ProfileCoordinator::StartCpuProfiling(int sample_interval_us) {
+  std::unique_lock<std::mutex> lock(lock_);
+  for (const auto& agent : agents_) {
+    agent.first->PostToMainThread([sample_interval_us](Agent* agent) {
+      if (!agent->StartCpuProfiling(sample_interval_us))
+        fprintf(stderr, "Could not start the CPU profiler\n");
+    });
+  }
+}
+
+void ProfileCoordinator::StopCpuProfiling(const std::string& path_prefix) {
+  std::unique_lock<std::mutex> lock(lock_);
+  if (agents_.empty())
+    return;
+  std::shared_ptr<Collection> collection =
+      std::make_shared<Collection>(agents_, path_prefix);
+  collection_ = collection;
+  for (const auto& agent : agents_) {
+    agent.first->PostToMainThread([collection](Agent* agent) {
+      collection->Add(agent, agent->TakeCpuProfile());
+    });
+  }
+}
+
+}  // namespace inspector
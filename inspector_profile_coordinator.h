@@ -0,0 +1,62 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#ifndef SRC_INSPECTOR_PROFILE_COORDINATOR_H_
+#define SRC_INSPECTOR_PROFILE_COORDINATOR_H_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace inspector {
+
+class Agent;
+
+// Profiles every isolate in the process together. CPU profiling starts and
+// stops on all registered agents at once, each on its own main thread, and
+// their profiles are merged into one, with every sample labeled with the
+// isolate it came from. All methods are thread-safe.
+class ProfileCoordinator {
+ public:
+  // label names the agent's isolate in the merged profile. An agent must be
+  // unregistered before it is destroyed.
+  __attribute__((visibility("default"))) void Register(Agent* agent, const std::string& label);
+  __attribute__((visibility("default"))) void Unregister(Agent* agent);
+
+  __attribute__((visibility("default"))) void StartCpuProfiling(int sample_interval_us);
+  // Stops CPU profiling everywhere. Once every agent has handed in its
+  // profile, they are merged on a background thread and written to
+  // path_prefix.pb.gz and path_prefix.folded, labeled "isolate".
+  __attribute__((visibility("default"))) void StopCpuProfiling(const std::string& path_prefix);
+
+ private:
+  class Collection;
+
+  std::mutex lock_;
+  std::map<Agent*, std::string> agents_;
+  std::shared_ptr<Collection> collection_;
+};
+
+}  // namespace inspector
+
+#endif  // SRC_INSPECTOR_PROFILE_COORDINATOR_H_
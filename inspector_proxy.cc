@@ -0,0 +1,799 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+// Exposes the inspector targets of many local processes through one port.
+// Endpoints are given on the command line, or read from the frontend URL
+// files the inspector agents write. Their /json/list responses are merged,
+// and each frontend WS session is relayed to its target over one upstream
+// connection. Payloads are passed through as bytes, never transcoded.
+//
+//   inspector_proxy [--host=H] [--port=P] [--url-file=PATH]... [ENDPOINT]...
+//
+// where ENDPOINT is host:port, [v6 host]:port or unix:/path/to/socket.
+
+#include "inspector_socket.h"
+#include "inspector_socket_server.h"
+
+#include "uv.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cassert>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace inspector {
+
+namespace {
+
+const int kRefreshIntervalMs = 1000;
+// An endpoint that takes longer to list its targets is treated as gone.
+const uint64_t kListTimeoutMs = 5000;
+const size_t kReadBufferSize = 64 * 1024;
+// The upstream servers are local, a fixed handshake key is enough.
+const char kWsKey[] = "dGhlIHNhbXBsZSBub25jZQ==";
+
+std::string FormatAddress(const std::string& host, int port) {
+  if (host.find(':') != std::string::npos)
+    return "[" + host + "]:" + std::to_string(port);
+  return host + ":" + std::to_string(port);
+}
+
+struct Endpoint {
+  Endpoint() : port(-1) { }
+  std::string host;
+  int port;
+  // Set for a Unix socket
+  std::string path;
+
+  bool operator<(const Endpoint& other) const {
+    if (path != other.path)
+      return path < other.path;
+    if (host != other.host)
+      return host < other.host;
+    return port < other.port;
+  }
+  std::string Name() const {
+    if (!path.empty())
+      return "unix:" + path;
+    return FormatAddress(host, port);
+  }
+};
+
+struct Target {
+  std::string title;
+  std::string url;
+  Endpoint endpoint;
+};
+
+// Parses host:port, [host]:port or unix:/path.
+bool ParseEndpoint(const std::string& spec, Endpoint* endpoint) {
+  if (spec.compare(0, 5, "unix:") == 0) {
+    endpoint->path = spec.substr(5);
+    return !endpoint->path.empty();
+  }
+  size_t colon = spec.rfind(':');
+  if (colon == std::string::npos || colon == 0)
+    return false;
+  std::string host = spec.substr(0, colon);
+  if (host[0] == '[' && host[host.size() - 1] == ']')
+    host = host.substr(1, host.size() - 2);
+  char* end;
+  long port = strtol(spec.c_str() + colon + 1, &end, 10);
+  if (*end != '\0' && *end != '/')
+    return false;
+  if (port <= 0 || port > 0xFFFF)
+    return false;
+  endpoint->host = host;
+  endpoint->port = static_cast<int>(port);
+  return true;
+}
+
+// Collects the endpoints from the "ws=host:port/id" parameters of the URLs in
+// a frontend URL file.
+void ReadUrlFile(const std::string& file, std::set<Endpoint>* endpoints) {
+  std::ifstream in(file);
+  std::string line;
+  while (std::getline(in, line)) {
+    size_t ws = line.find("ws=");
+    if (ws == std::string::npos)
+      continue;
+    Endpoint endpoint;
+    if (ParseEndpoint(line.substr(ws + 3, line.find('/', ws) - ws - 3),
+                      &endpoint)) {
+      endpoints->insert(endpoint);
+    }
+  }
+}
+
+// Reads the string members of the flat objects in a /json/list response.
+// Values are kept as they are, escapes included.
+std::vector<std::map<std::string, std::string>> ParseTargetList(
+    const std::string& json) {
+  std::vector<std::map<std::string, std::string>> list;
+  std::vector<std::string> strings;
+  for (size_t pos = 0; pos < json.size(); pos++) {
+    char c = json[pos];
+    if (c == '{') {
+      list.push_back(std::map<std::string, std::string>());
+      strings.clear();
+    } else if (c == '"') {
+      size_t end = pos + 1;
+      while (end < json.size() && json[end] != '"')
+        end += json[end] == '\\' ? 2 : 1;
+      if (end >= json.size())
+        break;
+      strings.push_back(json.substr(pos + 1, end - pos - 1));
+      pos = end;
+      if (strings.size() == 2 && !list.empty()) {
+        list.back()[strings[0]] = strings[1];
+        strings.clear();
+      }
+    } else if (c == ',' || c == '}') {
+      strings.clear();
+    }
+  }
+  return list;
+}
+
+}  // namespace
+
+class InspectorProxy;
+
+// A stream to an endpoint, over TCP or a Unix socket. Deletes itself once
+// closed.
+class Connection {
+ public:
+  Connection(InspectorProxy* proxy, const Endpoint& endpoint)
+      : proxy_(proxy), endpoint_(endpoint), closing_(false),
+        resolving_(false), read_buffer_(kReadBufferSize) {}
+  virtual ~Connection() {}
+
+  // On failure the connection is closed and must not be used any more.
+  int Connect(uv_loop_t* loop);
+  void Write(std::vector<std::string> chunks);
+  void Close();
+  const Endpoint& endpoint() const { return endpoint_; }
+
+ protected:
+  virtual void OnConnect() = 0;
+  virtual void OnData(const char* data, size_t length) = 0;
+  // Connection failed, or the other side closed it
+  virtual void OnError() = 0;
+
+  InspectorProxy* const proxy_;
+
+ private:
+  static Connection* From(uv_handle_t* handle) {
+    return static_cast<Connection*>(handle->data);
+  }
+  static void ResolveCallback(uv_getaddrinfo_t* req, int status,
+                              struct addrinfo* res);
+  static void ConnectCallback(uv_connect_t* req, int status);
+  static void AllocCallback(uv_handle_t* handle, size_t size, uv_buf_t* buf);
+  static void ReadCallback(uv_stream_t* stream, ssize_t nread,
+                           const uv_buf_t* buf);
+  static void CloseCallback(uv_handle_t* handle) {
+    delete From(handle);
+  }
+  uv_stream_t* stream() {
+    return endpoint_.path.empty() ? reinterpret_cast<uv_stream_t*>(&tcp_)
+                                  : reinterpret_cast<uv_stream_t*>(&pipe_);
+  }
+
+  const Endpoint endpoint_;
+  bool closing_;
+  // The handle is not closed while a lookup is in flight, as the lookup
+  // callback still refers to the connection.
+  bool resolving_;
+  uv_tcp_t tcp_;
+  uv_pipe_t pipe_;
+  uv_getaddrinfo_t resolve_req_;
+  uv_connect_t connect_req_;
+  std::vector<char> read_buffer_;
+};
+
+// GET /json/list on an endpoint.
+class ListRequest : public Connection {
+ public:
+  ListRequest(InspectorProxy* proxy, const Endpoint& endpoint,
+              uint64_t started_at)
+      : Connection(proxy, endpoint), started_at_(started_at) {}
+  uint64_t started_at() const { return started_at_; }
+  // Gives up on an endpoint that accepted the request and never answered
+  void TimedOut() { Finish(false); }
+
+ protected:
+  void OnConnect() override;
+  void OnData(const char* data, size_t length) override;
+  void OnError() override;
+
+ private:
+  void Finish(bool success);
+
+  const uint64_t started_at_;
+  std::string response_;
+};
+
+// WS client connection to one target, relaying a frontend session.
+class Upstream : public Connection {
+ public:
+  Upstream(InspectorProxy* proxy, const Endpoint& endpoint, int session_id,
+           const std::string& target_id)
+      : Connection(proxy, endpoint), session_id_(session_id),
+        target_id_(target_id), open_(false) {}
+  void Send(const std::string& message);
+  int session_id() const { return session_id_; }
+  const std::string& target_id() const { return target_id_; }
+
+ protected:
+  void OnConnect() override;
+  void OnData(const char* data, size_t length) override;
+  void OnError() override;
+
+ private:
+  void WriteFrames(std::vector<std::string> messages);
+
+  const int session_id_;
+  const std::string target_id_;
+  bool open_;
+  // Frontend messages received before the upstream handshake completed
+  std::vector<std::string> pending_;
+  std::string buffer_;
+};
+
+class InspectorProxy : public SocketServerDelegate {
+ public:
+  InspectorProxy(uv_loop_t* loop, const std::set<Endpoint>& endpoints,
+                 const std::vector<std::string>& url_files)
+      : loop_(loop), server_(nullptr), endpoints_(endpoints),
+        url_files_(url_files), stopping_(false) {}
+
+  void Start(InspectorSocketServer* server);
+  void Stop();
+
+  bool StartSession(int session_id, const std::string& target_id) override;
+  void EndSession(int session_id) override;
+  void MessageReceived(int session_id, const std::string& message) override;
+  std::vector<std::string> GetTargetIds() override;
+  std::string GetTargetTitle(const std::string& id) override;
+  std::string GetTargetUrl(const std::string& id) override;
+  std::string GetMetrics() override;
+  int OpenStreamFile(const std::string& handle, int64_t* size) override;
+  void ServerDone() override;
+
+  // Called by connections
+  void TargetsListed(ListRequest* request, bool success,
+                     const std::map<std::string, Target>& targets);
+  void UpstreamMessages(Upstream* upstream,
+                        std::vector<std::string> messages);
+  void UpstreamClosed(Upstream* upstream);
+
+ private:
+  static void RefreshCallback(uv_timer_t* timer);
+  static void SignalCallback(uv_signal_t* signal, int signum);
+  void Refresh();
+
+  uv_loop_t* const loop_;
+  InspectorSocketServer* server_;
+  const std::set<Endpoint> endpoints_;
+  const std::vector<std::string> url_files_;
+  std::map<std::string, Target> targets_;
+  std::map<Endpoint, ListRequest*> list_requests_;
+  std::map<int, Upstream*> upstreams_;
+  uv_timer_t refresh_timer_;
+  uv_signal_t sigint_;
+  uv_signal_t sigterm_;
+  bool stopping_;
+};
+
+// Connection implementation
+int Connection::Connect(uv_loop_t* loop) {
+  int err;
+  if (endpoint_.path.empty()) {
+    err = uv_tcp_init(loop, &tcp_);
+    assert(err == 0);
+    tcp_.data = this;
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_flags = AI_NUMERICSERV;
+    hints.ai_socktype = SOCK_STREAM;
+    // Resolved on the threadpool, so that a slow resolver does not hold up
+    // the relaying of other targets.
+    const std::string port_string = std::to_string(endpoint_.port);
+    resolve_req_.data = this;
+    err = uv_getaddrinfo(loop, &resolve_req_, ResolveCallback,
+                         endpoint_.host.c_str(), port_string.c_str(), &hints);
+    resolving_ = err == 0;
+  } else {
+    err = uv_pipe_init(loop, &pipe_, 0);
+    assert(err == 0);
+    pipe_.data = this;
+    uv_pipe_connect(&connect_req_, &pipe_, endpoint_.path.c_str(),
+                    ConnectCallback);
+  }
+  if (err != 0)
+    Close();
+  return err;
+}
+
+void Connection::Write(std::vector<std::string> chunks) {
+  if (closing_)
+    return;
+  struct WriteRequest {
+    std::vector<std::string> chunks;
+    std::vector<uv_buf_t> bufs;
+    uv_write_t req;
+  };
+  WriteRequest* wr = new WriteRequest();
+  wr->chunks = std::move(chunks);
+  for (std::string& chunk : wr->chunks) {
+    if (!chunk.empty())
+      wr->bufs.push_back(uv_buf_init(&chunk[0], chunk.size()));
+  }
+  wr->req.data = wr;
+  int err = uv_write(&wr->req, stream(), wr->bufs.data(), wr->bufs.size(),
+                     [](uv_write_t* req, int status) {
+                       delete static_cast<WriteRequest*>(req->data);
+                     });
+  if (err != 0)
+    delete wr;
+}
+
+void Connection::Close() {
+  if (closing_)
+    return;
+  closing_ = true;
+  if (resolving_) {
+    // ResolveCallback closes the handle.
+    uv_cancel(reinterpret_cast<uv_req_t*>(&resolve_req_));
+    return;
+  }
+  uv_close(reinterpret_cast<uv_handle_t*>(stream()), CloseCallback);
+}
+
+// static
+void Connection::ResolveCallback(uv_getaddrinfo_t* req, int status,
+                                 struct addrinfo* res) {
+  Connection* connection = static_cast<Connection*>(req->data);
+  connection->resolving_ = false;
+  if (connection->closing_) {
+    uv_freeaddrinfo(res);
+    uv_close(reinterpret_cast<uv_handle_t*>(connection->stream()),
+             CloseCallback);
+    return;
+  }
+  if (status == 0) {
+    status = uv_tcp_connect(&connection->connect_req_, &connection->tcp_,
+                            res->ai_addr, ConnectCallback);
+  }
+  uv_freeaddrinfo(res);
+  if (status != 0)
+    connection->OnError();
+}
+
+// static
+void Connection::ConnectCallback(uv_connect_t* req, int status) {
+  Connection* connection = From(reinterpret_cast<uv_handle_t*>(req->handle));
+  if (connection->closing_)
+    return;
+  if (status == 0) {
+    status = uv_read_start(connection->stream(), AllocCallback, ReadCallback);
+  }
+  if (status == 0)
+    connection->OnConnect();
+  else
+    connection->OnError();
+}
+
+// static
+void Connection::AllocCallback(uv_handle_t* handle, size_t size,
+                               uv_buf_t* buf) {
+  Connection* connection = From(handle);
+  buf->base = connection->read_buffer_.data();
+  buf->len = connection->read_buffer_.size();
+}
+
+// static
+void Connection::ReadCallback(uv_stream_t* stream, ssize_t nread,
+                              const uv_buf_t* buf) {
+  Connection* connection = From(reinterpret_cast<uv_handle_t*>(stream));
+  if (connection->closing_)
+    return;
+  if (nread > 0)
+    connection->OnData(buf->base, nread);
+  else if (nread < 0)
+    connection->OnError();
+}
+
+// ListRequest implementation
+void ListRequest::OnConnect() {
+  std::vector<std::string> request;
+  request.push_back("GET /json/list HTTP/1.1\r\nHost: " + endpoint().Name() +
+                    "\r\n\r\n");
+  Write(std::move(request));
+}
+
+void ListRequest::OnData(const char* data, size_t length) {
+  response_.append(data, length);
+  size_t body = response_.find("\r\n\r\n");
+  if (body == std::string::npos)
+    return;
+  body += 4;
+  // The response is sent with a Content-Length, on a connection that is kept
+  // open.
+  std::string headers = response_.substr(0, body);
+  for (char& c : headers)
+    c = ToLower(c);
+  size_t field = headers.find("content-length:");
+  if (field == std::string::npos) {
+    Finish(false);
+    return;
+  }
+  size_t content_length = strtoul(headers.c_str() + field + 15, nullptr, 10);
+  if (response_.size() - body >= content_length) {
+    response_ = response_.substr(body, content_length);
+    Finish(true);
+  }
+}
+
+void ListRequest::OnError() {
+  Finish(false);
+}
+
+void ListRequest::Finish(bool success) {
+  std::map<std::string, Target> targets;
+  if (success) {
+    for (auto& object : ParseTargetList(response_)) {
+      const std::string& id = object["id"];
+      if (id.empty())
+        continue;
+      Target& target = targets[id];
+      target.title = object["title"];
+      target.url = object["url"];
+      target.endpoint = endpoint();
+    }
+  }
+  proxy_->TargetsListed(this, success, targets);
+  Close();
+}
+
+// Upstream implementation
+void Upstream::OnConnect() {
+  std::vector<std::string> request;
+  request.push_back("GET /" + target_id_ + " HTTP/1.1\r\n"
+                    "Host: " + endpoint().Name() + "\r\n"
+                    "Upgrade: websocket\r\n"
+                    "Connection: Upgrade\r\n"
+                    "Sec-WebSocket-Key: " + kWsKey + "\r\n"
+                    "Sec-WebSocket-Version: 13\r\n\r\n");
+  Write(std::move(request));
+}
+
+void Upstream::OnData(const char* data, size_t length) {
+  buffer_.append(data, length);
+  if (!open_) {
+    size_t end = buffer_.find("\r\n\r\n");
+    if (end == std::string::npos)
+      return;
+    if (buffer_.compare(0, 12, "HTTP/1.1 101") != 0) {
+      OnError();
+      return;
+    }
+    buffer_.erase(0, end + 4);
+    open_ = true;
+    std::vector<std::string> pending;
+    pending.swap(pending_);
+    WriteFrames(std::move(pending));
+  }
+
+  // Everything received in one read goes to the frontend in one write.
+  std::vector<std::string> messages;
+  size_t consumed = 0;
+  bool closed = false;
+  while (!closed) {
+    size_t frame_length, payload_offset, payload_length;
+    inspector_frame_type type = inspector_parse_server_frame(
+        buffer_.data() + consumed, buffer_.size() - consumed, &frame_length,
+        &payload_offset, &payload_length);
+    if (type == kInspectorFrameIncomplete)
+      break;
+    if (type == kInspectorFrameText) {
+      messages.push_back(buffer_.substr(consumed + payload_offset,
+                                        payload_length));
+      consumed += frame_length;
+    } else if (type == kInspectorFramePing) {
+      // Answered with the same payload, unmasked as the key is zero
+      char header[kMaxClientFrameHeaderSize];
+      std::vector<std::string> pong;
+      pong.push_back(std::string(
+          header, inspector_client_pong_header(payload_length, header)));
+      pong.push_back(buffer_.substr(consumed + payload_offset,
+                                    payload_length));
+      Write(std::move(pong));
+      consumed += frame_length;
+    } else if (type == kInspectorFramePong) {
+      consumed += frame_length;
+    } else {
+      closed = true;
+    }
+  }
+  buffer_.erase(0, consumed);
+  if (!messages.empty())
+    proxy_->UpstreamMessages(this, std::move(messages));
+  if (closed)
+    OnError();
+}
+
+void Upstream::OnError() {
+  proxy_->UpstreamClosed(this);
+  Close();
+}
+
+void Upstream::Send(const std::string& message) {
+  if (!open_) {
+    pending_.push_back(message);
+    return;
+  }
+  std::vector<std::string> messages;
+  messages.push_back(message);
+  WriteFrames(std::move(messages));
+}
+
+void Upstream::WriteFrames(std::vector<std::string> messages) {
+  if (messages.empty())
+    return;
+  std::vector<std::string> chunks;
+  chunks.reserve(messages.size() * 2);
+  for (std::string& message : messages) {
+    char header[kMaxClientFrameHeaderSize];
+    size_t header_size = inspector_client_frame_header(message.size(), header);
+    chunks.push_back(std::string(header, header_size));
+    chunks.push_back(std::move(message));
+  }
+  Write(std::move(chunks));
+}
+
+// InspectorProxy implementation
+void InspectorProxy::Start(InspectorSocketServer* server) {
+  server_ = server;
+  int err = uv_timer_init(loop_, &refresh_timer_);
+  assert(err == 0);
+  err = uv_timer_start(&refresh_timer_, RefreshCallback, 0,
+                       kRefreshIntervalMs);
+  assert(err == 0);
+  uv_signal_init(loop_, &sigint_);
+  uv_signal_start(&sigint_, SignalCallback, SIGINT);
+  uv_signal_init(loop_, &sigterm_);
+  uv_signal_start(&sigterm_, SignalCallback, SIGTERM);
+}
+
+void InspectorProxy::Stop() {
+  if (stopping_)
+    return;
+  stopping_ = true;
+  server_->TerminateConnections();
+  server_->Stop(nullptr);
+}
+
+// static
+void InspectorProxy::RefreshCallback(uv_timer_t* timer) {
+  InspectorProxy* proxy = ContainerOf(&InspectorProxy::refresh_timer_, timer);
+  proxy->Refresh();
+}
+
+// static
+void InspectorProxy::SignalCallback(uv_signal_t* signal, int signum) {
+  InspectorProxy* proxy;
+  if (signum == SIGINT)
+    proxy = ContainerOf(&InspectorProxy::sigint_, signal);
+  else
+    proxy = ContainerOf(&InspectorProxy::sigterm_, signal);
+  proxy->Stop();
+}
+
+void InspectorProxy::Refresh() {
+  std::set<Endpoint> endpoints = endpoints_;
+  for (const std::string& file : url_files_)
+    ReadUrlFile(file, &endpoints);
+  // Targets of endpoints that are gone
+  for (auto it = targets_.begin(); it != targets_.end();) {
+    if (endpoints.count(it->second.endpoint) == 0)
+      it = targets_.erase(it);
+    else
+      ++it;
+  }
+  // Requests still unanswered are ended, dropping the targets of their
+  // endpoints, so that a stopped process does not stay listed.
+  std::vector<ListRequest*> timed_out;
+  for (const auto& request : list_requests_) {
+    if (uv_now(loop_) - request.second->started_at() >= kListTimeoutMs)
+      timed_out.push_back(request.second);
+  }
+  for (ListRequest* request : timed_out)
+    request->TimedOut();
+  for (const Endpoint& endpoint : endpoints) {
+    if (list_requests_.count(endpoint) != 0)
+      continue;
+    ListRequest* request = new ListRequest(this, endpoint, uv_now(loop_));
+    list_requests_[endpoint] = request;
+    if (request->Connect(loop_) != 0)
+      list_requests_.erase(endpoint);
+  }
+}
+
+void InspectorProxy::TargetsListed(
+    ListRequest* request, bool success,
+    const std::map<std::string, Target>& targets) {
+  const Endpoint endpoint = request->endpoint();
+  list_requests_.erase(endpoint);
+  for (auto it = targets_.begin(); it != targets_.end();) {
+    if (!(it->second.endpoint < endpoint) &&
+        !(endpoint < it->second.endpoint) && targets.count(it->first) == 0) {
+      it = targets_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  if (success) {
+    for (const auto& target : targets)
+      targets_[target.first] = target.second;
+  }
+}
+
+bool InspectorProxy::StartSession(int session_id,
+                                  const std::string& target_id) {
+  auto target = targets_.find(target_id);
+  if (target == targets_.end())
+    return false;
+  // One upstream connection per target
+  for (const auto& upstream : upstreams_) {
+    if (upstream.second->target_id() == target_id)
+      return false;
+  }
+  Upstream* upstream =
+      new Upstream(this, target->second.endpoint, session_id, target_id);
+  if (upstream->Connect(loop_) != 0)
+    return false;
+  upstreams_[session_id] = upstream;
+  return true;
+}
+
+void InspectorProxy::EndSession(int session_id) {
+  auto upstream = upstreams_.find(session_id);
+  if (upstream == upstreams_.end())
+    return;
+  Upstream* connection = upstream->second;
+  upstreams_.erase(upstream);
+  connection->Close();
+}
+
+void InspectorProxy::MessageReceived(int session_id,
+                                     const std::string& message) {
+  auto upstream = upstreams_.find(session_id);
+  if (upstream != upstreams_.end())
+    upstream->second->Send(message);
+}
+
+std::vector<std::string> InspectorProxy::GetTargetIds() {
+  std::vector<std::string> ids;
+  for (const auto& target : targets_)
+    ids.push_back(target.first);
+  return ids;
+}
+
+std::string InspectorProxy::GetTargetTitle(const std::string& id) {
+  auto target = targets_.find(id);
+  return target == targets_.end() ? std::string() : target->second.title;
+}
+
+std::string InspectorProxy::GetTargetUrl(const std::string& id) {
+  auto target = targets_.find(id);
+  return target == targets_.end() ? std::string() : target->second.url;
+}
+
+std::string InspectorProxy::GetMetrics() {
+  return "{\"targets\":" + std::to_string(targets_.size()) +
+         ",\"upstreams\":" + std::to_string(upstreams_.size()) + "}";
+}
+
+int InspectorProxy::OpenStreamFile(const std::string& handle,
+                                   int64_t* size) {
+  // Streams belong to the upstream agents; fetch them from there.
+  return -1;
+}
+
+void InspectorProxy::ServerDone() {
+  uv_close(reinterpret_cast<uv_handle_t*>(&refresh_timer_), nullptr);
+  uv_close(reinterpret_cast<uv_handle_t*>(&sigint_), nullptr);
+  uv_close(reinterpret_cast<uv_handle_t*>(&sigterm_), nullptr);
+  for (const auto& request : list_requests_)
+    request.second->Close();
+  list_requests_.clear();
+  for (const auto& upstream : upstreams_)
+    upstream.second->Close();
+  upstreams_.clear();
+}
+
+void InspectorProxy::UpstreamMessages(Upstream* upstream,
+                                      std::vector<std::string> messages) {
+  server_->Send(upstream->session_id(), std::move(messages));
+}
+
+void InspectorProxy::UpstreamClosed(Upstream* upstream) {
+  auto it = upstreams_.find(upstream->session_id());
+  if (it == upstreams_.end() || it->second != upstream)
+    return;
+  upstreams_.erase(it);
+  server_->TerminateSession(upstream->session_id());
+}
+
+}  // namespace inspector
+
+using namespace inspector;
+
+int main(int argc, char* argv[]) {
+  std::string host = "127.0.0.1";
+  int port = 9229;
+  std::set<Endpoint> endpoints;
+  std::vector<std::string> url_files;
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    Endpoint endpoint;
+    if (strncmp(arg, "--host=", 7) == 0) {
+      host = arg + 7;
+    } else if (strncmp(arg, "--port=", 7) == 0) {
+      port = atoi(arg + 7);
+    } else if (strncmp(arg, "--url-file=", 11) == 0) {
+      url_files.push_back(arg + 11);
+    } else if (ParseEndpoint(arg, &endpoint)) {
+      endpoints.insert(endpoint);
+    } else {
+      fprintf(stderr, "Usage: %s [--host=H] [--port=P] [--url-file=PATH]... "
+              "[host:port | unix:PATH]...\n", argv[0]);
+      return 1;
+    }
+  }
+
+  // libuv writes with write(), so a peer that resets its connection would
+  // otherwise take the proxy and every other session down with it.
+  signal(SIGPIPE, SIG_IGN);
+
+  uv_loop_t* loop = uv_default_loop();
+  InspectorProxy proxy(loop, endpoints, url_files);
+  InspectorSocketServer server(&proxy, loop, host, port, nullptr);
+  if (!server.Start()) {
+    fprintf(stderr, "Unable to listen on %s:%d\n", host.c_str(), port);
+    return 1;
+  }
+  fprintf(stderr, "Inspector proxy listening on http://%s/json/list\n",
+          FormatAddress(host, server.Port()).c_str());
+  proxy.Start(&server);
+  uv_run(loop, UV_RUN_DEFAULT);
+  return 0;
+}
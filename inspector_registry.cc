@@ -0,0 +1,173 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#include "inspector_registry.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace inspector {
+
+namespace {
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "registry atomics must be plain words");
+static_assert(sizeof(RegistrySlot) == 256, "registry slots are 256 bytes");
+
+// Slots start on their own cache line
+const uint32_t kSlotsOffset = 64;
+const uint32_t kInitializing = 1;
+const uint32_t kInitialized = 2;
+
+void CopyField(char* field, size_t size, const std::string& value) {
+  size_t length = std::min(value.size(), size - 1);
+  memcpy(field, value.data(), length);
+  memset(field + length, 0, size - length);
+}
+
+}  // namespace
+
+// static
+std::shared_ptr<TargetRegistry> TargetRegistry::Open(const std::string& path) {
+  static std::mutex registries_lock;
+  static auto* registries =
+      new std::map<std::string, std::weak_ptr<TargetRegistry>>();
+  std::lock_guard<std::mutex> lock(registries_lock);
+  std::weak_ptr<TargetRegistry>& entry = (*registries)[path];
+  std::shared_ptr<TargetRegistry> registry = entry.lock();
+  if (registry != nullptr)
+    return registry;
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return nullptr;
+  size_t size = kSlotsOffset + kRegistrySlots * sizeof(RegistrySlot);
+  struct stat st;
+  // Growing the file is harmless if another process does it too
+  if (fstat(fd, &st) != 0 ||
+      (static_cast<size_t>(st.st_size) < size && ftruncate(fd, size) != 0)) {
+    close(fd);
+    return nullptr;
+  }
+  void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                       0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return nullptr;
+
+  RegistryHeader* header = static_cast<RegistryHeader*>(mapping);
+  uint32_t state = 0;
+  if (header->initialized.compare_exchange_strong(state, kInitializing)) {
+    header->version = kRegistryVersion;
+    header->slot_count = kRegistrySlots;
+    header->slot_size = sizeof(RegistrySlot);
+    header->slots_offset = kSlotsOffset;
+    memcpy(header->magic, kRegistryMagic, sizeof(header->magic));
+    header->initialized.store(kInitialized, std::memory_order_release);
+  } else {
+    // Another process is setting the file up
+    for (int i = 0; i < 1000 && header->initialized.load() != kInitialized;
+         i++) {
+      std::this_thread::yield();
+    }
+  }
+  if (header->initialized.load(std::memory_order_acquire) != kInitialized ||
+      memcmp(header->magic, kRegistryMagic, sizeof(header->magic)) != 0 ||
+      header->version != kRegistryVersion ||
+      header->slot_size != sizeof(RegistrySlot)) {
+    munmap(mapping, size);
+    return nullptr;
+  }
+  registry.reset(new TargetRegistry(mapping, size));
+  entry = registry;
+  return registry;
+}
+
+TargetRegistry::TargetRegistry(void* mapping, size_t size)
+    : mapping_(mapping), size_(size) { }
+
+TargetRegistry::~TargetRegistry() {
+  munmap(mapping_, size_);
+}
+
+RegistrySlot* TargetRegistry::slot(int index) {
+  return reinterpret_cast<RegistrySlot*>(static_cast<char*>(mapping_) +
+                                         kSlotsOffset) + index;
+}
+
+bool TargetRegistry::Claim(int index, uint32_t pid) {
+  RegistrySlot* target = slot(index);
+  uint32_t owner = target->pid.load();
+  if (owner != 0 && (kill(owner, 0) == 0 || errno != ESRCH))
+    return false;
+  return target->pid.compare_exchange_strong(owner, pid);
+}
+
+int TargetRegistry::Add(const std::string& label, const std::string& host,
+                        int port, const std::string& target_id) {
+  uint32_t pid = static_cast<uint32_t>(getpid());
+  for (uint32_t index = 0; index < kRegistrySlots; index++) {
+    if (!Claim(index, pid))
+      continue;
+    RegistrySlot* target = slot(index);
+    // A dead owner may have left the slot half written
+    uint32_t sequence = target->sequence.load(std::memory_order_relaxed);
+    sequence |= 1;
+    target->sequence.store(sequence, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    target->port = port;
+    target->reserved = 0;
+    CopyField(target->label, sizeof(target->label), label);
+    CopyField(target->host, sizeof(target->host), host);
+    CopyField(target->target_id, sizeof(target->target_id), target_id);
+    target->sequence.store(sequence + 1, std::memory_order_release);
+    return index;
+  }
+  return -1;
+}
+
+void TargetRegistry::Remove(int index) {
+  if (index < 0 || index >= static_cast<int>(kRegistrySlots))
+    return;
+  RegistrySlot* target = slot(index);
+  uint32_t sequence = target->sequence.load(std::memory_order_relaxed) | 1;
+  target->sequence.store(sequence, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  target->port = 0;
+  memset(target->label, 0, sizeof(target->label));
+  memset(target->host, 0, sizeof(target->host));
+  memset(target->target_id, 0, sizeof(target->target_id));
+  target->sequence.store(sequence + 1, std::memory_order_release);
+  target->pid.store(0, std::memory_order_release);
+}
+
+}  // namespace inspector
@@ -0,0 +1,93 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#ifndef SRC_INSPECTOR_REGISTRY_H_
+#define SRC_INSPECTOR_REGISTRY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+namespace inspector {
+
+// A file, normally under /dev/shm, that lists the live inspector targets of
+// every process that maps it, so that tools can find them all with a single
+// mmap instead of reading a file or probing a port per target.
+//
+// The file holds a RegistryHeader followed by slot_count RegistrySlots. A
+// slot is free while its pid is zero. Writers claim a slot by swapping
+// their pid into it, or the pid of a process that no longer exists, and
+// update it seqlock-style: sequence is odd while the slot is being written.
+// Readers copy a slot and keep the copy if sequence was even and did not
+// change meanwhile.
+struct RegistryHeader {
+  char magic[8];  // kRegistryMagic once the file is set up
+  std::atomic<uint32_t> initialized;
+  uint32_t version;
+  uint32_t slot_count;
+  uint32_t slot_size;
+  uint32_t slots_offset;
+};
+
+struct RegistrySlot {
+  std::atomic<uint32_t> sequence;
+  std::atomic<uint32_t> pid;
+  uint32_t port;
+  uint32_t reserved;
+  // NUL-terminated, truncated to fit
+  char label[80];
+  char host[80];
+  char target_id[80];
+};
+
+const char kRegistryMagic[8] = {'V', '8', 'I', 'N', 'S', 'P', 'R', 'G'};
+const uint32_t kRegistryVersion = 1;
+const uint32_t kRegistrySlots = 1024;
+
+class TargetRegistry {
+ public:
+  // Maps the registry at path, creating it if needed. The mapping is shared
+  // by every user in the process. Returns nullptr on failure.
+  static std::shared_ptr<TargetRegistry> Open(const std::string& path);
+  ~TargetRegistry();
+
+  // Returns the slot the target went into, or -1 if the registry is full.
+  int Add(const std::string& label, const std::string& host, int port,
+          const std::string& target_id);
+  void Remove(int slot);
+
+ private:
+  TargetRegistry(void* mapping, size_t size);
+  RegistrySlot* slot(int index);
+  // Takes slot index for this process, if it is free or its owner is dead
+  bool Claim(int index, uint32_t pid);
+
+  void* const mapping_;
+  const size_t size_;
+};
+
+}  // namespace inspector
+
+#endif  // SRC_INSPECTOR_REGISTRY_H_
@@ -0,0 +1,181 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#include "inspector_script_cache.h"
+
+#include "inspector_json.h"
+
+#include <string.h>
+
+namespace inspector {
+
+namespace {
+
+const char kResultPrefix[] = ",\"result\":";
+
+std::string ScriptIdParam(const ProtocolEnvelope& envelope) {
+  std::string script_id;
+  if (envelope.params == nullptr)
+    return script_id;
+  JsonObjectScanner params(envelope.params, envelope.params_length);
+  while (params.Next()) {
+    if (params.KeyIs("scriptId")) {
+      JsonStringValue(params.value(), params.value_length(), &script_id);
+      break;
+    }
+  }
+  return script_id;
+}
+
+bool ValueIs(const JsonObjectScanner& scanner, const char* quoted) {
+  return strlen(quoted) == scanner.value_length() &&
+         memcmp(quoted, scanner.value(), scanner.value_length()) == 0;
+}
+
+}  // namespace
+
+InspectorScriptCache::InspectorScriptCache() : bytes_(0),
+                                               max_bytes_(kDefaultMaxBytes) { }
+
+void InspectorScriptCache::SetMaxBytes(size_t max_bytes) {
+  std::unique_lock<std::mutex> lock(lock_);
+  max_bytes_ = max_bytes;
+  if (max_bytes_ == 0)
+    hashes_.clear();
+  Trim();
+}
+
+void InspectorScriptCache::Evict(const std::string& script_id) {
+  auto it = entries_.find(script_id);
+  if (it == entries_.end())
+    return;
+  bytes_ -= it->second.tail.size();
+  lru_.erase(it->second.lru);
+  entries_.erase(it);
+}
+
+void InspectorScriptCache::Trim() {
+  while (bytes_ > max_bytes_)
+    Evict(lru_.back());
+}
+
+bool InspectorScriptCache::HandleRequest(const ProtocolEnvelope& envelope,
+                                         std::string* response) {
+  if (envelope.method == "Debugger.setScriptSource") {
+    std::string script_id = ScriptIdParam(envelope);
+    std::unique_lock<std::mutex> lock(lock_);
+    hashes_.erase(script_id);
+    Evict(script_id);
+    return false;
+  }
+  if (envelope.method != "Debugger.getScriptSource" || !envelope.has_id)
+    return false;
+  std::string script_id = ScriptIdParam(envelope);
+  std::unique_lock<std::mutex> lock(lock_);
+  if (max_bytes_ == 0 || script_id.empty())
+    return false;
+  // Until the script is reported in this session, its entry can be neither
+  // used nor found stale.
+  auto hash = hashes_.find(script_id);
+  if (hash == hashes_.end())
+    return false;
+  auto it = entries_.find(script_id);
+  if (it != entries_.end()) {
+    if (hash->second == it->second.hash) {
+      lru_.splice(lru_.begin(), lru_, it->second.lru);
+      response->clear();
+      AppendResponsePrefix(response, envelope.id);
+      response->append(it->second.tail);
+      return true;
+    }
+    Evict(script_id);
+  }
+  pending_[envelope.id] = script_id;
+  return false;
+}
+
+void InspectorScriptCache::MessageSent(const std::string& message) {
+  // Only the first member is looked at, unless it makes the message
+  // interesting. V8 puts "id" first in responses and "method" first in
+  // notifications.
+  JsonObjectScanner scanner(message.data(), message.size());
+  if (!scanner.Next())
+    return;
+  if (scanner.KeyIs("method")) {
+    if (!ValueIs(scanner, "\"Debugger.scriptParsed\""))
+      return;
+    while (scanner.Next()) {
+      if (!scanner.KeyIs("params"))
+        continue;
+      std::string script_id;
+      std::string hash;
+      JsonObjectScanner params(scanner.value(), scanner.value_length());
+      while (params.Next()) {
+        if (params.KeyIs("scriptId"))
+          JsonStringValue(params.value(), params.value_length(), &script_id);
+        else if (params.KeyIs("hash"))
+          JsonStringValue(params.value(), params.value_length(), &hash);
+      }
+      std::unique_lock<std::mutex> lock(lock_);
+      if (max_bytes_ != 0 && !hash.empty())
+        hashes_[script_id] = hash;
+      return;
+    }
+    return;
+  }
+  if (!scanner.KeyIs("id"))
+    return;
+  int64_t id;
+  if (!JsonIntegerValue(scanner.value(), scanner.value_length(), &id))
+    return;
+  std::unique_lock<std::mutex> lock(lock_);
+  auto pending = pending_.find(id);
+  if (pending == pending_.end())
+    return;
+  std::string script_id = pending->second;
+  pending_.erase(pending);
+
+  const char* tail = scanner.value() + scanner.value_length();
+  size_t tail_length = message.data() + message.size() - tail;
+  auto hash = hashes_.find(script_id);
+  if (hash == hashes_.end() || tail_length > max_bytes_ ||
+      tail_length < sizeof(kResultPrefix) - 1 ||
+      memcmp(tail, kResultPrefix, sizeof(kResultPrefix) - 1) != 0) {
+    return;
+  }
+  Evict(script_id);
+  lru_.push_front(script_id);
+  Entry& entry = entries_[script_id];
+  entry.hash = hash->second;
+  entry.tail.assign(tail, tail_length);
+  entry.lru = lru_.begin();
+  bytes_ += tail_length;
+  Trim();
+}
+
+void InspectorScriptCache::SessionEnded() {
+  std::unique_lock<std::mutex> lock(lock_);
+  pending_.clear();
+  hashes_.clear();
+}
+
+}  // namespace inspector
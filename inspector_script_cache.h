@@ -0,0 +1,86 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#ifndef SRC_INSPECTOR_SCRIPT_CACHE_H_
+#define SRC_INSPECTOR_SCRIPT_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace inspector {
+
+struct ProtocolEnvelope;
+
+// Keeps the serialized Debugger.getScriptSource responses that V8 sent, so
+// that a frontend asking again (on reload or reconnect) is answered from the
+// IO thread without involving the isolate. An entry is only used while the
+// script's hash, as reported by Debugger.scriptParsed, is unchanged. Hashes
+// are kept for the current session only, as V8 reports every script again on
+// the next Debugger.enable. Debugger.setScriptSource drops the script's entry
+// and hash until it is reported again. All methods are thread-safe.
+class InspectorScriptCache {
+ public:
+  static const size_t kDefaultMaxBytes = 32 << 20;
+
+  InspectorScriptCache();
+
+  // Least recently used sources are dropped to stay under max_bytes. Zero
+  // disables the cache.
+  void SetMaxBytes(size_t max_bytes);
+
+  // Called for each request from the frontend. Answers a cached
+  // Debugger.getScriptSource into *response and returns true.
+  bool HandleRequest(const ProtocolEnvelope& envelope, std::string* response);
+  // Called for each message V8 sends to the frontend.
+  void MessageSent(const std::string& message);
+  void SessionEnded();
+
+ private:
+  struct Entry {
+    std::string hash;
+    // The response after its id, starting with ,"result":
+    std::string tail;
+    std::list<std::string>::iterator lru;
+  };
+
+  void Evict(const std::string& script_id);
+  void Trim();
+
+  std::mutex lock_;
+  std::map<std::string, Entry> entries_;
+  // Script ids, most recently used first
+  std::list<std::string> lru_;
+  std::map<std::string, std::string> hashes_;
+  // getScriptSource requests that went to V8, by request id
+  std::map<int64_t, std::string> pending_;
+  size_t bytes_;
+  size_t max_bytes_;
+};
+
+}  // namespace inspector
+
+#endif  // SRC_INSPECTOR_SCRIPT_CACHE_H_
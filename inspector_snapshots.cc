@@ -0,0 +1,349 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#include "inspector_snapshots.h"
+
+#include "inspector_io.h"
+#include "inspector_json.h"
+#include "inspector_util.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+namespace inspector {
+
+namespace {
+
+const int kDefaultMaxFrames = 8;
+const size_t kDefaultMaxBytes = 64 * 1024;
+const double kDefaultMaxPerSecond = 1;
+const int kDefaultBurst = 5;
+
+}  // namespace
+
+SnapshotBreakpoints::SnapshotBreakpoints(
+    v8_inspector::V8Inspector* inspector, int context_group_id,
+    Callback callback) : callback_(callback), next_call_id_(1),
+                         max_frames_(kDefaultMaxFrames),
+                         max_bytes_(kDefaultMaxBytes),
+                         max_per_second_(kDefaultMaxPerSecond),
+                         burst_(kDefaultBurst) {
+  session_ = inspector->connect(context_group_id, this,
+                                v8_inspector::StringView());
+  Call("Debugger.enable", "{}");
+}
+
+SnapshotBreakpoints::~SnapshotBreakpoints() {
+  session_.reset();
+}
+
+std::string SnapshotBreakpoints::Set(const std::string& url, int line_number,
+                                     int column_number,
+                                     const std::string& condition) {
+  std::string params = "{\"url\":" + JsonQuote(url) +
+                       ",\"lineNumber\":" + std::to_string(line_number) +
+                       ",\"columnNumber\":" + std::to_string(column_number);
+  if (!condition.empty())
+    params += ",\"condition\":" + JsonQuote(condition);
+  params += "}";
+  std::string result = Call("Debugger.setBreakpointByUrl", params);
+  std::string raw_id = JsonRawMember(result, "breakpointId", "");
+  std::string id;
+  if (!JsonStringValue(raw_id.data(), raw_id.size(), &id))
+    return std::string();
+  breakpoints_.erase(id);
+  breakpoints_.emplace(id, Breakpoint(burst_));
+  return id;
+}
+
+void SnapshotBreakpoints::Remove(const std::string& id) {
+  if (breakpoints_.erase(id) == 0)
+    return;
+  Call("Debugger.removeBreakpoint", "{\"breakpointId\":" + JsonQuote(id) + "}");
+}
+
+void SnapshotBreakpoints::SetLimits(int max_frames, size_t max_bytes) {
+  max_frames_ = max_frames;
+  max_bytes_ = max_bytes;
+}
+
+void SnapshotBreakpoints::SetRate(double max_per_second, int burst) {
+  max_per_second_ = std::max(max_per_second, 0.0);
+  burst_ = std::max(burst, 1);
+  for (auto& breakpoint : breakpoints_)
+    breakpoint.second.bucket.Limit(burst_);
+}
+
+bool SnapshotBreakpoints::TakeToken(Breakpoint* breakpoint) {
+  if (breakpoint->bucket.Take(max_per_second_, burst_))
+    return true;
+  breakpoint->suppressed++;
+  return false;
+}
+
+void SnapshotBreakpoints::sendResponse(
+    int call_id, std::unique_ptr<v8_inspector::StringBuffer> message) {
+  responses_[call_id] = StringViewToUtf8(message->string());
+}
+
+void SnapshotBreakpoints::sendNotification(
+    std::unique_ptr<v8_inspector::StringBuffer> message) {
+  std::string json = StringViewToUtf8(message->string());
+  ProtocolEnvelope envelope;
+  ScanProtocolEnvelope(json.data(), json.size(), &envelope);
+  if (envelope.method == "Debugger.paused" && envelope.params != nullptr)
+    paused_.assign(envelope.params, envelope.params_length);
+  else if (envelope.method == "Debugger.resumed")
+    paused_.clear();
+}
+
+std::string SnapshotBreakpoints::Call(const std::string& method,
+                                      const std::string& params) {
+  int id = next_call_id_++;
+  std::string message = "{\"id\":" + std::to_string(id) +
+                        ",\"method\":" + JsonQuote(method) +
+                        ",\"params\":" + params + "}";
+  session_->dispatchProtocolMessage(Utf8ToStringView(message)->string());
+  auto response = responses_.find(id);
+  if (response == responses_.end())
+    return std::string();
+  std::string result = JsonRawMember(response->second, "result", "");
+  responses_.erase(response);
+  return result;
+}
+
+void SnapshotBreakpoints::AppendLocals(const char* scope_chain, size_t length,
+                                       std::string* locals) {
+  JsonArrayScanner scopes(scope_chain, length);
+  while (scopes.Next()) {
+    std::string scope(scopes.value(), scopes.value_length());
+    std::string type = JsonRawMember(scope, "type", "");
+    if (type != "\"local\"" && type != "\"block\"")
+      continue;
+    std::string object = JsonRawMember(scope, "object", "{}");
+    std::string object_id = JsonRawMember(object, "objectId", "");
+    if (object_id.empty())
+      continue;
+    std::string result = Call("Runtime.getProperties",
+                              "{\"objectId\":" + object_id +
+                              ",\"ownProperties\":true"
+                              ",\"generatePreview\":true}");
+    std::string properties = JsonRawMember(result, "result", "[]");
+    JsonArrayScanner scanner(properties.data(), properties.size());
+    while (scanner.Next()) {
+      if (locals->size() > 1)
+        locals->push_back(',');
+      locals->append(scanner.value(), scanner.value_length());
+    }
+  }
+}
+
+bool SnapshotBreakpoints::HandlePause() {
+  if (paused_.empty())
+    return false;
+  std::string paused;
+  paused.swap(paused_);
+
+  std::string call_frames = JsonRawMember(paused, "callFrames", "[]");
+  std::string top_frame_id;
+  JsonArrayScanner top_frame(call_frames.data(), call_frames.size());
+  if (top_frame.Next()) {
+    top_frame_id = JsonRawMember(
+        std::string(top_frame.value(), top_frame.value_length()),
+        "callFrameId", "");
+  }
+
+  std::string hit_id;
+  bool handled = false;
+  bool others = false;
+  std::string hit = JsonRawMember(paused, "hitBreakpoints", "[]");
+  JsonArrayScanner hit_breakpoints(hit.data(), hit.size());
+  while (hit_breakpoints.Next()) {
+    std::string id;
+    JsonStringValue(hit_breakpoints.value(), hit_breakpoints.value_length(),
+                    &id);
+    if (breakpoints_.count(id) != 0)
+      hit_id = id;
+    else if (hit_handler_ != nullptr && hit_handler_(id, top_frame_id))
+      handled = true;
+    else
+      others = true;
+  }
+  if (hit_id.empty()) {
+    if (!handled || others)
+      return false;
+    Resume();
+    return true;
+  }
+  Breakpoint& breakpoint = breakpoints_.find(hit_id)->second;
+  if (!TakeToken(&breakpoint)) {
+    if (others)
+      return false;
+    Resume();
+    return true;
+  }
+  uint64_t suppressed = breakpoint.suppressed;
+  breakpoint.suppressed = 0;
+
+  int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  std::string snapshot = "{\"breakpointId\":" + JsonQuote(hit_id) +
+                         ",\"time\":" + std::to_string(now) +
+                         ",\"suppressed\":" + std::to_string(suppressed) +
+                         ",\"callFrames\":[";
+  bool truncated = false;
+  JsonArrayScanner frames(call_frames.data(), call_frames.size());
+  for (int count = 0; frames.Next(); count++) {
+    if (count == max_frames_) {
+      truncated = true;
+      break;
+    }
+    std::string frame(frames.value(), frames.value_length());
+    if (count > 0)
+      snapshot.push_back(',');
+    snapshot += "{\"functionName\":" +
+                JsonRawMember(frame, "functionName", "\"\"") +
+                ",\"url\":" + JsonRawMember(frame, "url", "\"\"") +
+                ",\"location\":" + JsonRawMember(frame, "location", "null") +
+                ",\"locals\":";
+    std::string locals = "[";
+    if (snapshot.size() < max_bytes_) {
+      std::string scope_chain = JsonRawMember(frame, "scopeChain", "[]");
+      AppendLocals(scope_chain.data(), scope_chain.size(), &locals);
+    }
+    locals.push_back(']');
+    if (snapshot.size() + locals.size() > max_bytes_) {
+      truncated = true;
+      snapshot += "null}";
+    } else {
+      snapshot += locals + "}";
+    }
+  }
+  snapshot += "],\"truncated\":";
+  snapshot += truncated ? "true}" : "false}";
+  callback_(snapshot);
+
+  if (others)
+    return false;
+  Resume();
+  return true;
+}
+
+void SnapshotBreakpoints::Resume() {
+  Call("Debugger.resume", "{}");
+}
+
+SnapshotWriter::SnapshotWriter() : keep_count_(kDefaultKeepCount),
+                                   written_(0),
+                                   stopping_(false) { }
+
+SnapshotWriter::~SnapshotWriter() {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  if (thread_.joinable())
+    thread_.join();
+}
+
+void SnapshotWriter::SetDirectory(const std::string& directory,
+                                  int keep_count) {
+  std::lock_guard<std::mutex> guard(lock_);
+  directory_ = directory;
+  keep_count_ = std::max(keep_count, 0);
+}
+
+void SnapshotWriter::set_keep_count(int keep_count) {
+  std::lock_guard<std::mutex> guard(lock_);
+  keep_count_ = std::max(keep_count, 0);
+}
+
+bool SnapshotWriter::Write(const std::string& snapshot) {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (directory_.empty() || stopping_)
+    return true;
+  if (queue_.size() >= kMaxQueued)
+    return false;
+  int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  char name[64];
+  snprintf(name, sizeof(name), "Snapshot.%lld.%d.%06d.json",
+           static_cast<long long>(now), static_cast<int>(getpid()),
+           ++written_);
+  queue_.push_back(File());
+  queue_.back().path = directory_ + "/" + name;
+  queue_.back().snapshot = snapshot;
+  if (!thread_.joinable())
+    thread_ = std::thread([this]() { Run(); });
+  wake_.notify_one();
+  return true;
+}
+
+void SnapshotWriter::Run() {
+  std::unique_lock<std::mutex> lock(lock_);
+  while (true) {
+    wake_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+    if (queue_.empty())
+      return;
+    File file = std::move(queue_.front());
+    queue_.pop_front();
+    std::string directory = directory_;
+    int keep_count = keep_count_;
+    lock.unlock();
+
+    if (WriteFileAtomically(file.path, file.snapshot)) {
+      if (keep_count > 0 && !directory.empty())
+        RotateFiles(directory, "Snapshot.", ".json", keep_count);
+    } else {
+      fprintf(stderr, "Could not write %s\n", file.path.c_str());
+    }
+    lock.lock();
+  }
+}
+
+void RotateFiles(const std::string& directory, const std::string& prefix,
+                 const std::string& suffix, int keep_count) {
+  DIR* dir = opendir(directory.c_str());
+  if (dir == nullptr)
+    return;
+  std::vector<std::string> names;
+  while (dirent* entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name.size() > prefix.size() + suffix.size() &&
+        name.compare(0, prefix.size(), prefix) == 0 &&
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+      names.push_back(name);
+    }
+  }
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+  for (size_t i = 0; i + keep_count < names.size(); i++)
+    unlink((directory + "/" + names[i]).c_str());
+}
+
+}  // namespace inspector
@@ -0,0 +1,168 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#ifndef SRC_INSPECTOR_SNAPSHOTS_H_
+#define SRC_INSPECTOR_SNAPSHOTS_H_
+
+#include "inspector_util.h"
+#include "v8-inspector.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace inspector {
+
+// Breakpoints that nobody stops at. They live in a session of their own.
+// When one is hit, the call frames and their local variables are read
+// through that session while the isolate is paused, and then it resumes
+// right away. Main thread only.
+class SnapshotBreakpoints : public v8_inspector::V8Inspector::Channel {
+ public:
+  // Receives each snapshot as a JSON object.
+  using Callback = std::function<void(const std::string& snapshot)>;
+  // Offered each hit of a breakpoint set through Call() that is not a
+  // snapshot breakpoint, with the id of the top call frame as a JSON
+  // string. Returns true if it took care of the hit, which then does not
+  // pause either.
+  using HitHandler = std::function<bool(const std::string& breakpoint_id,
+                                        const std::string& call_frame_id)>;
+
+  SnapshotBreakpoints(v8_inspector::V8Inspector* inspector,
+                      int context_group_id, Callback callback);
+  ~SnapshotBreakpoints() override;
+
+  // Returns the breakpoint id, or an empty string if V8 refused it. The
+  // breakpoint is only taken when condition, if any, is true.
+  std::string Set(const std::string& url, int line_number, int column_number,
+                  const std::string& condition);
+  void Remove(const std::string& id);
+  // Snapshots cover at most max_frames frames and come to about max_bytes.
+  void SetLimits(int max_frames, size_t max_bytes);
+  // Each breakpoint takes at most burst snapshots back to back, and
+  // max_per_second on average after that; zero means no limit. Other hits
+  // resume at once, and are counted in the next snapshot taken.
+  void SetRate(double max_per_second, int burst);
+  void set_hit_handler(HitHandler handler) { hit_handler_ = handler; }
+
+  // Called first thing on every pause. If only snapshot breakpoints and
+  // breakpoints the hit handler took were hit, takes the snapshot, resumes
+  // and returns true.
+  bool HandlePause();
+  // Resumes a pause nobody else is going to handle.
+  void Resume();
+
+  // Dispatches a request to the session, which answers before returning.
+  // Returns the "result" object, or an empty string on error.
+  std::string Call(const std::string& method, const std::string& params);
+
+ private:
+  struct Breakpoint {
+    explicit Breakpoint(double burst) : bucket(burst), suppressed(0) { }
+    TokenBucket bucket;
+    // Hits not snapshotted since the last snapshot
+    uint64_t suppressed;
+  };
+
+  // Takes a token from the breakpoint's bucket if there is one
+  bool TakeToken(Breakpoint* breakpoint);
+
+  void sendResponse(
+      int call_id,
+      std::unique_ptr<v8_inspector::StringBuffer> message) override;
+  void sendNotification(
+      std::unique_ptr<v8_inspector::StringBuffer> message) override;
+  void flushProtocolNotifications() override { }
+
+  // Appends the properties of the local scopes in scope_chain to *locals.
+  void AppendLocals(const char* scope_chain, size_t length,
+                    std::string* locals);
+
+  std::unique_ptr<v8_inspector::V8InspectorSession> session_;
+  const Callback callback_;
+  HitHandler hit_handler_;
+  int next_call_id_;
+  std::map<int, std::string> responses_;
+  std::map<std::string, Breakpoint> breakpoints_;
+  // The params of the last Debugger.paused notification
+  std::string paused_;
+  int max_frames_;
+  size_t max_bytes_;
+  double max_per_second_;
+  double burst_;
+};
+
+// Writes snapshots to files, one at a time on a thread of its own. Each file
+// is written under a temporary name and renamed once complete, so that a
+// process exiting mid-write leaves no partial snapshot behind. Thread-safe.
+class SnapshotWriter {
+ public:
+  // Snapshots waiting to be written beyond this many are dropped.
+  static const size_t kMaxQueued = 16;
+  static const int kDefaultKeepCount = 100;
+
+  SnapshotWriter();
+  // Writes what is queued, then stops the thread.
+  ~SnapshotWriter();
+
+  // An empty directory stops writing. Only the newest keep_count snapshot
+  // files are left in directory; zero keeps them all.
+  void SetDirectory(const std::string& directory, int keep_count);
+  void set_keep_count(int keep_count);
+  // Queues snapshot. Returns false if it was dropped.
+  bool Write(const std::string& snapshot);
+
+ private:
+  struct File {
+    std::string path;
+    std::string snapshot;
+  };
+
+  void Run();
+
+  std::mutex lock_;
+  std::condition_variable wake_;
+  std::deque<File> queue_;
+  std::string directory_;
+  int keep_count_;
+  int written_;
+  bool stopping_;
+  // Started with the first snapshot
+  std::thread thread_;
+};
+
+// Removes the oldest files in directory whose names start with prefix and
+// end with suffix, leaving keep_count. Names must sort by age.
+void RotateFiles(const std::string& directory, const std::string& prefix,
+                 const std::string& suffix, int keep_count);
+
+}  // namespace inspector
+
+#endif  // SRC_INSPECTOR_SNAPSHOTS_H_
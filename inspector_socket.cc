@@ -26,10 +26,21 @@
 
 #include "openssl/sha.h"  // Sha-1 hash
 
+#include <errno.h>
+#include <fcntl.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
 #include <vector>
 #include <cassert>
 
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#define HAVE_SENDFILE 1
+#else
+#define HAVE_SENDFILE 0
+#endif
+
 
 #define ACCEPT_KEY_LENGTH base64_encoded_size(20)
 #define BUFFER_GROWTH_CHUNK_SIZE 1024
@@ -75,6 +86,9 @@ static void remove_from_beginning(std::vector<char>* buffer, size_t count) {
   buffer->erase(buffer->begin(), buffer->begin() + count);
 }
 
+// dispose_inspector references send_file_end
+static void send_file_end(SendFileRequest* sf);
+
 static void dispose_inspector(uv_handle_t* handle) {
   InspectorSocket* inspector = inspector_from_stream(handle);
   inspector_cb close =
@@ -82,6 +96,8 @@ static void dispose_inspector(uv_handle_t* handle) {
   inspector->buffer.clear();
   delete inspector->ws_state;
   inspector->ws_state = nullptr;
+  if (inspector->send_file != nullptr)
+    send_file_end(inspector->send_file);
   if (close) {
     close(inspector, 0);
   }
@@ -131,6 +147,136 @@ static int write_to_client(InspectorSocket* inspector,
   return uv_write(&wr->req, stream, &wr->buf, 1, write_cb) < 0;
 }
 
+// A file sent as an HTTP response body. The header goes out through libuv;
+// the body is copied by the kernel straight from the page cache to the
+// socket, a chunk each time a uv_poll_t on the socket's loop finds it
+// writable. The poll watches a duplicate of the socket descriptor, as libuv
+// does not allow two handles on one.
+struct SendFileRequest {
+  SendFileRequest(InspectorSocket* inspector, const char* header,
+                  size_t header_len, int file_fd, int64_t length)
+      : inspector(inspector)
+      , header(header, header + header_len)
+      , buf(uv_buf_init(&this->header[0], this->header.size()))
+      , polling(false)
+      , file_fd(file_fd)
+      , socket_fd(-1)
+      , length(length)
+      , sent(0)
+#if !HAVE_SENDFILE
+      , block(64 * 1024)
+      , block_start(0)
+      , block_end(0)
+#endif
+      {}
+  ~SendFileRequest() {
+    close(file_fd);
+    if (socket_fd >= 0)
+      close(socket_fd);
+  }
+
+  // nullptr once the request is detached from the socket
+  InspectorSocket* inspector;
+  std::vector<char> header;
+  uv_buf_t buf;
+  uv_write_t write_req;
+  uv_poll_t poll;
+  bool polling;
+  const int file_fd;
+  int socket_fd;
+  const int64_t length;
+  int64_t sent;
+#if !HAVE_SENDFILE
+  std::vector<char> block;
+  size_t block_start;
+  size_t block_end;
+#endif
+};
+
+static void send_file_closed(uv_handle_t* handle) {
+  SendFileRequest* sf = ContainerOf(&SendFileRequest::poll,
+                                    reinterpret_cast<uv_poll_t*>(handle));
+  delete sf;
+}
+
+// Detaches the request from its socket and frees it, once its poll handle
+// has closed.
+static void send_file_end(SendFileRequest* sf) {
+  if (sf->inspector != nullptr) {
+    sf->inspector->send_file = nullptr;
+    sf->inspector = nullptr;
+  }
+  if (!sf->polling) {
+    delete sf;
+    return;
+  }
+  uv_handle_t* poll = reinterpret_cast<uv_handle_t*>(&sf->poll);
+  if (!uv_is_closing(poll))
+    uv_close(poll, send_file_closed);
+}
+
+// Returns the result of one non-blocking sendfile() or its emulation.
+static ssize_t send_file_chunk(SendFileRequest* sf) {
+#if HAVE_SENDFILE
+  off_t offset = sf->sent;
+  return sendfile(sf->socket_fd, sf->file_fd, &offset,
+                  sf->length - sf->sent);
+#else
+  if (sf->block_start == sf->block_end) {
+    int64_t want = sf->length - sf->sent;
+    if (want > static_cast<int64_t>(sf->block.size()))
+      want = sf->block.size();
+    ssize_t n;
+    do {
+      n = pread(sf->file_fd, sf->block.data(), want, sf->sent);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+      return n;
+    sf->block_start = 0;
+    sf->block_end = n;
+  }
+  ssize_t n = write(sf->socket_fd, sf->block.data() + sf->block_start,
+                    sf->block_end - sf->block_start);
+  if (n > 0)
+    sf->block_start += n;
+  return n;
+#endif
+}
+
+static void send_file_writable(uv_poll_t* poll, int status, int events) {
+  SendFileRequest* sf = ContainerOf(&SendFileRequest::poll, poll);
+  while (status == 0 && sf->sent < sf->length) {
+    ssize_t n = send_file_chunk(sf);
+    if (n > 0) {
+      sf->sent += n;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;  // Wait for the peer to drain the socket
+    } else if (n == 0 || errno != EINTR) {
+      break;  // The file got shorter, or the connection is gone
+    }
+  }
+  // HTTP/1.0 response: the end of the body is the end of the connection. The
+  // peer closes in turn and the loop sees EOF.
+  shutdown(sf->socket_fd, SHUT_WR);
+  send_file_end(sf);
+}
+
+static void send_file_header_written(uv_write_t* req, int status) {
+  SendFileRequest* sf = ContainerOf(&SendFileRequest::write_req, req);
+  uv_handle_t* handle = reinterpret_cast<uv_handle_t*>(req->handle);
+  uv_os_fd_t fd;
+  if (status < 0 || sf->inspector == nullptr ||
+      uv_fileno(handle, &fd) != 0 ||
+      (sf->socket_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0)) < 0 ||
+      uv_poll_init(handle->loop, &sf->poll, sf->socket_fd) != 0) {
+    send_file_end(sf);
+    return;
+  }
+  sf->polling = true;
+  if (uv_poll_start(&sf->poll, UV_WRITABLE, send_file_writable) != 0)
+    send_file_end(sf);
+}
+
 // Constants for hybi-10 frame format.
 
 typedef int OpCode;
@@ -155,34 +301,75 @@ const size_t kTwoBytePayloadLengthField = 126;
 const size_t kEightBytePayloadLengthField = 127;
 const size_t kMaskingKeyWidthInBytes = 4;
 
-static std::vector<char> encode_frame_hybi17(const char* message,
-                                             size_t data_length) {
-  std::vector<char> frame;
+const size_t kMaxFrameHeaderSize = 2 + 8;
+
+// Writes the header of an unmasked text frame carrying data_length bytes and
+// returns its size.
+static size_t encode_frame_header_hybi17(size_t data_length, char* header) {
+  size_t size = 0;
   OpCode op_code = kOpCodeText;
-  frame.push_back(kFinalBit | op_code);
+  header[size++] = kFinalBit | op_code;
   if (data_length <= kMaxSingleBytePayloadLength) {
-    frame.push_back(static_cast<char>(data_length));
+    header[size++] = static_cast<char>(data_length);
   } else if (data_length <= 0xFFFF) {
-    frame.push_back(kTwoBytePayloadLengthField);
-    frame.push_back((data_length & 0xFF00) >> 8);
-    frame.push_back(data_length & 0xFF);
+    header[size++] = kTwoBytePayloadLengthField;
+    header[size++] = (data_length & 0xFF00) >> 8;
+    header[size++] = data_length & 0xFF;
   } else {
-    frame.push_back(kEightBytePayloadLengthField);
-    char extended_payload_length[8];
+    header[size++] = kEightBytePayloadLengthField;
     size_t remaining = data_length;
     // Fill the length into extended_payload_length in the network byte order.
     for (int i = 0; i < 8; ++i) {
-      extended_payload_length[7 - i] = remaining & 0xFF;
+      header[size + 7 - i] = remaining & 0xFF;
       remaining >>= 8;
     }
-    frame.insert(frame.end(), extended_payload_length,
-                 extended_payload_length + 8);
+    size += 8;
     assert(0 == remaining);
   }
+  return size;
+}
+
+static std::vector<char> encode_frame_hybi17(const char* message,
+                                             size_t data_length) {
+  char header[kMaxFrameHeaderSize];
+  size_t header_size = encode_frame_header_hybi17(data_length, header);
+  std::vector<char> frame(header, header + header_size);
   frame.insert(frame.end(), message, message + data_length);
   return frame;
 }
 
+// Several frames sent with a single uv_write(), i.e. one writev() instead of
+// one write() per message. The payloads are owned by the request, not copied.
+struct FramesWriteRequest {
+  explicit FramesWriteRequest(std::vector<std::string> messages)
+      : payloads(std::move(messages)),
+        headers(payloads.size() * kMaxFrameHeaderSize) {
+    bufs.reserve(payloads.size() * 2);
+    for (size_t i = 0; i < payloads.size(); i++) {
+      char* header = &headers[i * kMaxFrameHeaderSize];
+      size_t header_size =
+          encode_frame_header_hybi17(payloads[i].size(), header);
+      bufs.push_back(uv_buf_init(header, header_size));
+      if (!payloads[i].empty()) {
+        bufs.push_back(uv_buf_init(&payloads[i][0], payloads[i].size()));
+      }
+    }
+  }
+
+  static FramesWriteRequest* from_write_req(uv_write_t* req) {
+    return ContainerOf(&FramesWriteRequest::req, req);
+  }
+
+  static void Cleanup(uv_write_t* req, int status) {
+    delete from_write_req(req);
+  }
+
+  std::vector<std::string> payloads;
+  std::vector<char> headers;
+  std::vector<uv_buf_t> bufs;
+  uv_write_t req;
+};
+
 static ws_decode_result decode_frame_hybi17(const std::vector<char>& buffer,
                                             bool client_frame,
                                             int* bytes_consumed,
@@ -579,26 +766,62 @@ static void init_handshake(InspectorSocket* socket) {
   settings->on_url = path_cb;
 }
 
+static int start_handshake(InspectorSocket* socket, handshake_cb callback) {
+  init_handshake(socket);
+  socket->http_parsing_state->callback = callback;
+  return uv_read_start(reinterpret_cast<uv_stream_t*>(&socket->tcp),
+                       prepare_buffer, data_received_cb);
+}
+
 int inspector_accept(uv_stream_t* server, InspectorSocket* socket,
                      handshake_cb callback) {
   assert(callback != nullptr);
   assert(socket->http_parsing_state == nullptr);
 
   socket->http_parsing_state = new http_parsing_state_s();
+  socket->http_parsing_state->callback = callback;
   uv_stream_t* tcp = reinterpret_cast<uv_stream_t*>(&socket->tcp);
   int err = uv_tcp_init(server->loop, &socket->tcp);
+  if (err != 0) {
+    cleanup_http_parsing_state(socket);
+    callback(socket, kInspectorHandshakeFailed, std::string());
+    return err;
+  }
 
+  err = uv_accept(server, tcp);
   if (err == 0) {
-    err = uv_accept(server, tcp);
+    err = start_handshake(socket, callback);
   }
-  if (err == 0) {
-    init_handshake(socket);
-    socket->http_parsing_state->callback = callback;
-    err = uv_read_start(tcp, prepare_buffer,
-                        data_received_cb);
+  if (err != 0) {
+    uv_close(reinterpret_cast<uv_handle_t*>(tcp), report_handshake_failure_cb);
+  }
+  return err;
+}
+
+int inspector_open(uv_loop_t* loop, uv_os_sock_t fd, InspectorSocket* socket,
+                   handshake_cb callback) {
+  assert(callback != nullptr);
+  assert(socket->http_parsing_state == nullptr);
+
+  socket->http_parsing_state = new http_parsing_state_s();
+  socket->http_parsing_state->callback = callback;
+  uv_stream_t* tcp = reinterpret_cast<uv_stream_t*>(&socket->tcp);
+  int err = uv_tcp_init(loop, &socket->tcp);
+  if (err != 0) {
+    close(fd);
+    cleanup_http_parsing_state(socket);
+    callback(socket, kInspectorHandshakeFailed, std::string());
+    return err;
+  }
+
+  err = uv_tcp_open(&socket->tcp, fd);
+  if (err != 0) {
+    close(fd);
+  } else {
+    err = start_handshake(socket, callback);
   }
   if (err != 0) {
-    uv_close(reinterpret_cast<uv_handle_t*>(tcp), NULL);
+    uv_close(reinterpret_cast<uv_handle_t*>(tcp), report_handshake_failure_cb);
   }
   return err;
 }
@@ -613,6 +836,48 @@ void inspector_write(InspectorSocket* inspector, const char* data,
   }
 }
 
+void inspector_write_frames(InspectorSocket* inspector,
+                            std::vector<std::string> messages) {
+  assert(inspector->ws_mode);
+  if (messages.empty())
+    return;
+  // Freed in FramesWriteRequest::Cleanup
+  FramesWriteRequest* wr = new FramesWriteRequest(std::move(messages));
+  uv_stream_t* stream = reinterpret_cast<uv_stream_t*>(&inspector->tcp);
+  if (uv_write(&wr->req, stream, wr->bufs.data(), wr->bufs.size(),
+               FramesWriteRequest::Cleanup) < 0) {
+    delete wr;
+  }
+}
+
+void inspector_send_file(InspectorSocket* inspector, const char* header,
+                         size_t header_len, int file_fd, int64_t length) {
+  assert(!inspector->ws_mode);
+  if (inspector->send_file != nullptr) {
+    // The response in flight ends the connection; nothing may follow it.
+    close(file_fd);
+    return;
+  }
+  // Freed in send_file_end
+  SendFileRequest* sf = new SendFileRequest(inspector, header, header_len,
+                                            file_fd, length);
+  inspector->send_file = sf;
+  uv_stream_t* stream = reinterpret_cast<uv_stream_t*>(&inspector->tcp);
+  if (uv_write(&sf->write_req, stream, &sf->buf, 1,
+               send_file_header_written) < 0) {
+    send_file_end(sf);
+  }
+}
+
+void inspector_cancel_send_file(InspectorSocket* inspector) {
+  uv_os_fd_t fd;
+  if (inspector->send_file != nullptr &&
+      uv_fileno(reinterpret_cast<uv_handle_t*>(&inspector->tcp), &fd) == 0) {
+    // The read side reports EOF; closing the handle then ends the transfer.
+    shutdown(fd, SHUT_RD);
+  }
+}
+
 void inspector_close(InspectorSocket* inspector,
                      inspector_cb callback) {
   // libuv throws assertions when closing stream that's already closed - we
@@ -631,15 +896,87 @@ void inspector_close(InspectorSocket* inspector,
   }
 }
 
+size_t inspector_client_frame_header(size_t data_length, char* header) {
+  size_t size = encode_frame_header_hybi17(data_length, header);
+  header[1] |= kMaskBit;
+  memset(header + size, 0, kMaskingKeyWidthInBytes);
+  return size + kMaskingKeyWidthInBytes;
+}
+
+size_t inspector_client_pong_header(size_t data_length, char* header) {
+  size_t size = inspector_client_frame_header(data_length, header);
+  header[0] = kFinalBit | kOpCodePong;
+  return size;
+}
+
+inspector_frame_type inspector_parse_server_frame(const char* data,
+                                                  size_t length,
+                                                  size_t* frame_length,
+                                                  size_t* payload_offset,
+                                                  size_t* payload_length) {
+  if (length < 2)
+    return kInspectorFrameIncomplete;
+  unsigned char first_byte = data[0];
+  unsigned char second_byte = data[1];
+  if ((first_byte & kFinalBit) == 0 || (second_byte & kMaskBit) != 0 ||
+      (first_byte & (kReserved1Bit | kReserved2Bit | kReserved3Bit)) != 0) {
+    return kInspectorFrameError;
+  }
+  int op_code = first_byte & kOpCodeMask;
+  inspector_frame_type type;
+  switch (op_code) {
+  case kOpCodeText:
+    type = kInspectorFrameText;
+    break;
+  case kOpCodeClose:
+    type = kInspectorFrameClose;
+    break;
+  case kOpCodePing:
+    type = kInspectorFramePing;
+    break;
+  case kOpCodePong:
+    type = kInspectorFramePong;
+    break;
+  default:
+    return kInspectorFrameError;
+  }
+
+  size_t offset = 2;
+  uint64_t payload_length64 = second_byte & kPayloadLengthMask;
+  if (payload_length64 > kMaxSingleBytePayloadLength) {
+    size_t extended_payload_length_size =
+        payload_length64 == kTwoBytePayloadLengthField ? 2 : 8;
+    if (length < offset + extended_payload_length_size)
+      return kInspectorFrameIncomplete;
+    payload_length64 = 0;
+    for (size_t i = 0; i < extended_payload_length_size; i++) {
+      payload_length64 <<= 8;
+      payload_length64 |= static_cast<unsigned char>(data[offset++]);
+    }
+  }
+  if (payload_length64 > length - offset)
+    return kInspectorFrameIncomplete;
+  *payload_offset = offset;
+  *payload_length = static_cast<size_t>(payload_length64);
+  *frame_length = offset + *payload_length;
+  return type;
+}
+
 bool inspector_is_active(const InspectorSocket* inspector) {
   const uv_handle_t* tcp =
       reinterpret_cast<const uv_handle_t*>(&inspector->tcp);
   return !inspector->shutting_down && !uv_is_closing(tcp);
 }
 
+InspectorSocket::~InspectorSocket() {
+  // Only left when the loop closed the handles itself, and is done with them
+  delete send_file;
+}
+
 void InspectorSocket::reinit() {
   http_parsing_state = nullptr;
   ws_state = nullptr;
+  send_file = nullptr;
   buffer.clear();
   ws_mode = false;
   shutting_down = false;
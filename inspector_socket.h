@@ -39,6 +39,7 @@ enum inspector_handshake_event {
 };
 
 class InspectorSocket;
+struct SendFileRequest;
 
 typedef void (*inspector_cb)(InspectorSocket*, int);
 // Notifies as handshake is progressing. Returning false as a response to
@@ -128,12 +129,16 @@ inline ContainerOfHelper<Inner, Outer> ContainerOf(Inner Outer::*field,
 class InspectorSocket {
  public:
   InspectorSocket() : data(nullptr), http_parsing_state(nullptr),
-                      ws_state(nullptr), buffer(0), ws_mode(false),
-                      shutting_down(false), connection_eof(false) { }
+                      ws_state(nullptr), send_file(nullptr), buffer(0),
+                      ws_mode(false), shutting_down(false),
+                      connection_eof(false) { }
+  ~InspectorSocket();
   void reinit();
   void* data;
   struct http_parsing_state_s* http_parsing_state;
   struct ws_state_s* ws_state;
+  // The file being sent by inspector_send_file()
+  struct SendFileRequest* send_file;
   std::vector<char> buffer;
   uv_tcp_t tcp;
   bool ws_mode;
@@ -141,8 +146,15 @@ class InspectorSocket {
   bool connection_eof;
 };
 
+// On failure the socket is reported to callback as kInspectorHandshakeFailed,
+// either before the call returns or once its handle has closed. It must not
+// be freed before that.
 int inspector_accept(uv_stream_t* server, InspectorSocket* inspector,
                      handshake_cb callback);
+// Like inspector_accept, for a connection that was accepted elsewhere. The
+// socket takes ownership of fd, which is closed if the call fails.
+int inspector_open(uv_loop_t* loop, uv_os_sock_t fd,
+                   InspectorSocket* inspector, handshake_cb callback);
 
 void inspector_close(InspectorSocket* inspector,
                      inspector_cb callback);
@@ -154,8 +166,43 @@ int inspector_read_start(InspectorSocket* inspector, uv_alloc_cb,
 void inspector_read_stop(InspectorSocket* inspector);
 void inspector_write(InspectorSocket* inspector,
     const char* data, size_t len);
+// Sends each message as its own frame, all in one write.
+void inspector_write_frames(InspectorSocket* inspector,
+                            std::vector<std::string> messages);
+// Writes an HTTP response header and then the first length bytes of file_fd,
+// then ends the connection. The body is sent with non-blocking sendfile()
+// as the socket drains, on its loop. Takes ownership of file_fd.
+void inspector_send_file(InspectorSocket* inspector, const char* header,
+                         size_t header_len, int file_fd, int64_t length);
+// Ends the transfer if a file is still being sent over the socket. Reading
+// then reports EOF, and the socket closes as it would if the peer went away.
+void inspector_cancel_send_file(InspectorSocket* inspector);
 bool inspector_is_active(const InspectorSocket* inspector);
 
+// Client side framing, for connections made to another inspector server.
+const size_t kMaxClientFrameHeaderSize = 2 + 8 + 4;
+// Writes the header of a masked text frame and returns its size. The masking
+// key is zero, so the payload goes out as is.
+size_t inspector_client_frame_header(size_t data_length, char* header);
+// Same, for a pong frame answering a ping with the given payload size.
+size_t inspector_client_pong_header(size_t data_length, char* header);
+
+enum inspector_frame_type {
+  kInspectorFrameText,
+  kInspectorFrameClose,
+  kInspectorFramePing,
+  kInspectorFramePong,
+  kInspectorFrameIncomplete,
+  kInspectorFrameError
+};
+// Looks at the first frame in data, as sent by a server. For complete
+// frames, sets the size of the whole frame and where its payload is.
+inspector_frame_type inspector_parse_server_frame(const char* data,
+                                                  size_t length,
+                                                  size_t* frame_length,
+                                                  size_t* payload_offset,
+                                                  size_t* payload_length);
+
 inline InspectorSocket* inspector_from_stream(uv_tcp_t* stream) {
   return ContainerOf(&InspectorSocket::tcp, stream);
 }
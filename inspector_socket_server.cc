@@ -26,13 +26,25 @@
 #include "uv.h"
 #include "zlib.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <functional>
 #include <map>
+#include <memory>
 #include <set>
 #include <sstream>
 #include <cstring>
 #include <cassert>
 
+#if defined(__linux__) && defined(SO_REUSEPORT)
+#define HAVE_REUSEPORT_ACCEPTORS 1
+#else
+#define HAVE_REUSEPORT_ACCEPTORS 0
+#endif
 
 namespace inspector {
 
@@ -144,6 +156,21 @@ void SendHttpResponse(InspectorSocket* socket, const std::string& response) {
   inspector_write(socket, response.data(), response.size());
 }
 
+// Large artifacts such as heap snapshots go out without passing through
+// user space; see inspector_send_file().
+void SendFileResponse(InspectorSocket* socket, int fd, int64_t size) {
+  const char HEADERS[] = "HTTP/1.0 200 OK\r\n"
+                         "Content-Type: application/octet-stream\r\n"
+                         "Cache-Control: no-cache\r\n"
+                         "Connection: close\r\n"
+                         "Content-Length: %lld\r\n"
+                         "\r\n";
+  char header[sizeof(HEADERS) + 20];
+  int header_len = snprintf(header, sizeof(header), HEADERS,
+                            static_cast<long long>(size));  // NOLINT
+  inspector_send_file(socket, header, header_len, fd, size);
+}
+
 void SendVersionResponse(InspectorSocket* socket) {
   std::map<std::string, std::string> response;
   response["Browser"] = "v8inspector";
@@ -193,6 +220,52 @@ int GetSocketHost(uv_tcp_t* socket, std::string* out_host) {
   *out_host = ip;
   return err;
 }
+
+// FNV-1a over the peer IP address, so that all connections from one host map
+// to the same IO loop.
+size_t HashPeerAddress(uv_os_sock_t fd) {
+  sockaddr_storage addr;
+  socklen_t len = sizeof(addr);
+  if (getpeername(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0)
+    return 0;
+  const uint8_t* bytes;
+  size_t size;
+  if (addr.ss_family == AF_INET6) {
+    const sockaddr_in6* v6 = reinterpret_cast<const sockaddr_in6*>(&addr);
+    bytes = reinterpret_cast<const uint8_t*>(&v6->sin6_addr);
+    size = sizeof(v6->sin6_addr);
+  } else {
+    const sockaddr_in* v4 = reinterpret_cast<const sockaddr_in*>(&addr);
+    bytes = reinterpret_cast<const uint8_t*>(&v4->sin_addr);
+    size = sizeof(v4->sin_addr);
+  }
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+void FreeTcpOnClose(uv_handle_t* handle) {
+  delete reinterpret_cast<uv_tcp_t*>(handle);
+}
+// Fills *address if host is an IPv4 or IPv6 address, rather than a name.
+bool ParseNumericAddress(const std::string& host, int port,
+                         sockaddr_storage* address) {
+  memset(address, 0, sizeof(*address));
+  if (uv_ip4_addr(host.c_str(), port,
+                  reinterpret_cast<sockaddr_in*>(address)) == 0) {
+    return true;
+  }
+  std::string ip6 = host;
+  // As in a URL
+  if (ip6.size() > 2 && ip6.front() == '[' && ip6.back() == ']')
+    ip6 = ip6.substr(1, ip6.size() - 2);
+  return uv_ip6_addr(ip6.c_str(), port,
+                     reinterpret_cast<sockaddr_in6*>(address)) == 0;
+}
+
 }  // namespace
 
 
@@ -233,14 +306,81 @@ class Closer {
   int close_count_;
 };
 
+// A loop serving sessions. It is either the server loop, or a loop owned by
+// the IoLoop and run on its own thread. Tasks may be posted from any thread.
+class IoLoop {
+ public:
+  // Wraps the server loop; called on its thread.
+  static IoLoop* Wrap(uv_loop_t* loop);
+  static IoLoop* Spawn();
+
+  // Runs task on the loop. Returns false, dropping the task, once the loop
+  // is shutting down.
+  bool Post(std::function<void()> task);
+  bool IsCurrent() const;
+  uv_loop_t* loop() { return loop_; }
+
+  // Sessions assigned to the loop, including those still being opened
+  int load() const { return load_; }
+  void AddLoad() { load_++; }
+  void RemoveLoad() { load_--; }
+  // Called on the loop
+  void AddSession(SocketSession* session) { sessions_.insert(session); }
+  void RemoveSession(SocketSession* session) { sessions_.erase(session); }
+
+  // Runs the tasks already posted and stops taking new ones. A spawned loop
+  // then drops its remaining connections and exits. Called on the server
+  // loop.
+  void Shutdown();
+  // Waits for the thread of a spawned loop to exit.
+  void Join();
+
+ private:
+  IoLoop() : loop_(nullptr), owns_loop_(false), closed_(false), load_(0) {}
+  static void ThreadMain(void* io_loop);
+  static void AsyncCallback(uv_async_t* async);
+  static void CloseHandle(uv_handle_t* handle, void* arg);
+  // Returns true if the loop is shutting down.
+  bool RunTasks();
+
+  uv_loop_t* loop_;
+  uv_loop_t own_loop_;
+  bool owns_loop_;
+  // The thread the loop runs on: the one it was wrapped on, or its own.
+  // Several servers may share a thread, so this is per loop.
+  uv_thread_t thread_;
+  uv_async_t async_;
+  // Guards tasks_ and closed_
+  std::mutex lock_;
+  std::vector<std::function<void()>> tasks_;
+  bool closed_;
+  std::atomic<int> load_;
+  std::set<SocketSession*> sessions_;
+};
+
 class SocketSession {
  public:
   static int Accept(InspectorSocketServer* server, int server_port,
-                    uv_stream_t* server_socket);
+                    uv_stream_t* server_socket, IoLoop* io_loop);
+  // Takes ownership of fd. io_loop must be the current loop.
+  static int Open(InspectorSocketServer* server, int server_port,
+                  IoLoop* io_loop, uv_os_sock_t fd);
   void Send(const std::string& message);
+  void Send(std::vector<std::string> messages);
   void Close();
+  void CancelSendFile() { inspector_cancel_send_file(&socket_); }
+  static SocketSession* From(InspectorSocket* socket) {
+    return ContainerOf(&SocketSession::socket_, socket);
+  }
 
   int id() const { return id_; }
+  // nullptr when the server has no IO loop pool
+  IoLoop* io_loop() const { return io_loop_; }
+  // Whether the session may be used from the calling thread
+  bool OnCurrentLoop() const {
+    return io_loop_ == nullptr || io_loop_->IsCurrent();
+  }
+  bool IsClosing() const { return state_ == State::kClosing; }
   bool IsForTarget(const std::string& target_id) const {
     return target_id_ == target_id;
   }
@@ -250,9 +390,6 @@ class SocketSession {
 
  private:
   SocketSession(InspectorSocketServer* server, int server_port);
-  static SocketSession* From(InspectorSocket* socket) {
-    return ContainerOf(&SocketSession::socket_, socket);
-  }
 
   enum class State { kHttp, kWebSocket, kClosing, kEOF, kDeclined };
   static bool HandshakeCallback(InspectorSocket* socket,
@@ -272,6 +409,7 @@ class SocketSession {
   const int id_;
   InspectorSocket socket_;
   InspectorSocketServer* server_;
+  IoLoop* io_loop_;
   std::string target_id_;
   State state_;
   const int server_port_;
@@ -280,12 +418,14 @@ class SocketSession {
 class ServerSocket {
  public:
   static int Listen(InspectorSocketServer* inspector_server,
-                    sockaddr* addr, uv_loop_t* loop);
+                    sockaddr* addr, uv_loop_t* loop,
+                    const ServerSocketOptions& options);
   void Close() {
     uv_close(reinterpret_cast<uv_handle_t*>(&tcp_socket_),
              SocketClosedCallback);
   }
   int port() const { return port_; }
+  int GetAddress(sockaddr_storage* addr) const;
 
  private:
   explicit ServerSocket(InspectorSocketServer* server)
@@ -308,22 +448,63 @@ class ServerSocket {
   int port_;
 };
 
+// Extra listening socket on the same address and port as a ServerSocket
+// (SO_REUSEPORT), served by its own thread and loop. The kernel spreads
+// incoming connections across all sockets on the port; connections accepted
+// here are handed over to the IO loops.
+class Acceptor {
+ public:
+  static Acceptor* Start(InspectorSocketServer* server,
+                         const sockaddr_storage& addr, int port, int backlog);
+  // Called on the server loop; returns once the thread has exited.
+  void Stop();
+
+ private:
+  Acceptor(InspectorSocketServer* server, int port)
+      : server_(server), port_(port), fd_(-1) {}
+  static void ThreadMain(void* acceptor);
+  static void PollCallback(uv_poll_t* poll, int status, int events);
+  static void StopCallback(uv_async_t* async);
+
+  InspectorSocketServer* const server_;
+  const int port_;
+  int fd_;
+  uv_thread_t thread_;
+  uv_loop_t loop_;
+  uv_poll_t poll_;
+  uv_async_t stop_async_;
+};
+
 InspectorSocketServer::InspectorSocketServer(SocketServerDelegate* delegate,
                                              uv_loop_t* loop,
                                              const std::string& host,
                                              int port,
-                                             FILE* out) : loop_(loop),
-                                                          delegate_(delegate),
-                                                          host_(host),
-                                                          port_(port),
-                                                          closer_(nullptr),
-                                                          next_session_id_(0),
-                                                          out_(out) {
+                                             FILE* out,
+                                             const ServerSocketOptions& options)
+                                             : loop_(loop),
+                                               delegate_(delegate),
+                                               host_(host),
+                                               port_(port),
+                                               closer_(nullptr),
+                                               ending_sessions_(0),
+                                               next_session_id_(0),
+                                               out_(out),
+                                               done_(false),
+                                               options_(options) {
   state_ = ServerState::kNew;
 }
 
+InspectorSocketServer::~InspectorSocketServer() {
+  // Spawned loops were shut down by Done().
+  for (IoLoop* io_loop : io_loops_) {
+    io_loop->Join();
+    delete io_loop;
+  }
+}
+
 bool InspectorSocketServer::SessionStarted(SocketSession* session,
                                            const std::string& id) {
+  std::lock_guard<std::mutex> guard(sessions_lock_);
   if (TargetExists(id) && delegate_->StartSession(session->id(), id)) {
     connected_sessions_[session->id()] = session;
     return true;
@@ -334,19 +515,56 @@ bool InspectorSocketServer::SessionStarted(SocketSession* session,
 
 void InspectorSocketServer::SessionTerminated(SocketSession* session) {
   int id = session->id();
-  if (connected_sessions_.erase(id) != 0) {
-    delegate_->EndSession(id);
-    if (connected_sessions_.empty()) {
-      if (state_ == ServerState::kRunning && !server_sockets_.empty()) {
-        PrintDebuggerReadyMessage(host_, server_sockets_[0]->port(),
-                                  delegate_->GetTargetIds(), out_);
-      }
-      if (state_ == ServerState::kStopped) {
-        delegate_->ServerDone();
-      }
-    }
+  IoLoop* io_loop = session->io_loop();
+  bool was_connected;
+  {
+    std::lock_guard<std::mutex> guard(sessions_lock_);
+    was_connected = connected_sessions_.erase(id) != 0;
+    if (was_connected)
+      ending_sessions_++;
+    streaming_sessions_.erase(session);
+  }
+  if (io_loop != nullptr) {
+    io_loop->RemoveSession(session);
+    io_loop->RemoveLoad();
   }
   delete session;
+  if (!was_connected)
+    return;
+  if (io_loop == nullptr || io_loop == io_loops_[0])
+    SessionEnded(id);
+  else
+    io_loops_[0]->Post([this, id]() { SessionEnded(id); });
+}
+
+void InspectorSocketServer::SessionEnded(int session_id) {
+  delegate_->EndSession(session_id);
+  {
+    std::lock_guard<std::mutex> guard(sessions_lock_);
+    ending_sessions_--;
+  }
+  if (HasSessions())
+    return;
+  if (state_ == ServerState::kRunning && !server_sockets_.empty()) {
+    PrintDebuggerReadyMessage(host_, server_sockets_[0]->port(),
+                              delegate_->GetTargetIds(), out_);
+  }
+  if (state_ == ServerState::kStopped) {
+    Done();
+  }
+}
+
+bool InspectorSocketServer::HasSessions() {
+  std::lock_guard<std::mutex> guard(sessions_lock_);
+  return !connected_sessions_.empty() || ending_sessions_ > 0;
+}
+
+void InspectorSocketServer::Done() {
+  if (done_)
+    return;
+  done_ = true;
+  delegate_->ServerDone();
+  StopIoLoops();
 }
 
 bool InspectorSocketServer::HandleGetRequest(InspectorSocket* socket,
@@ -364,6 +582,20 @@ bool InspectorSocketServer::HandleGetRequest(InspectorSocket* socket,
   } else if (MatchPathSegment(command, "version")) {
     SendVersionResponse(socket);
     return true;
+  } else if (MatchPathSegment(command, "metrics")) {
+    SendHttpResponse(socket, delegate_->GetMetrics());
+    return true;
+  } else if (const char* handle = MatchPathSegment(command, "stream")) {
+    int64_t size;
+    int fd = delegate_->OpenStreamFile(handle, &size);
+    if (fd < 0)
+      return false;
+    {
+      std::lock_guard<std::mutex> guard(sessions_lock_);
+      streaming_sessions_.insert(SocketSession::From(socket));
+    }
+    SendFileResponse(socket, fd, size);
+    return true;
   } else if (const char* target_id = MatchPathSegment(command, "activate")) {
     if (TargetExists(target_id)) {
       SendHttpResponse(socket, "Target activated");
@@ -390,10 +622,13 @@ void InspectorSocketServer::SendListResponse(InspectorSocket* socket) {
     Escape(&target_map["url"]);
 
     bool connected = false;
-    for (const auto& session : connected_sessions_) {
-      if (session.second->IsForTarget(id)) {
-        connected = true;
-        break;
+    {
+      std::lock_guard<std::mutex> guard(sessions_lock_);
+      for (const auto& session : connected_sessions_) {
+        if (session.second->IsForTarget(id)) {
+          connected = true;
+          break;
+        }
       }
     }
     if (!connected) {
@@ -414,26 +649,34 @@ void InspectorSocketServer::SendListResponse(InspectorSocket* socket) {
 
 bool InspectorSocketServer::Start() {
   assert(state_ == ServerState::kNew);
-  struct addrinfo hints;
-  memset(&hints, 0, sizeof(hints));
-  hints.ai_flags = AI_NUMERICSERV;
-  hints.ai_socktype = SOCK_STREAM;
-  uv_getaddrinfo_t req;
-  const std::string port_string = std::to_string(port_);
-  int err = uv_getaddrinfo(loop_, &req, nullptr, host_.c_str(),
-                           port_string.c_str(), &hints);
-  if (err < 0) {
-    if (out_ != NULL) {
-      fprintf(out_, "Unable to resolve \"%s\": %s\n", host_.c_str(),
-              uv_strerror(err));
+  int err;
+  sockaddr_storage numeric;
+  if (ParseNumericAddress(host_, port_, &numeric)) {
+    // Nothing to resolve
+    err = ServerSocket::Listen(this, reinterpret_cast<sockaddr*>(&numeric),
+                               loop_, options_);
+  } else {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_flags = AI_NUMERICSERV;
+    hints.ai_socktype = SOCK_STREAM;
+    uv_getaddrinfo_t req;
+    const std::string port_string = std::to_string(port_);
+    err = uv_getaddrinfo(loop_, &req, nullptr, host_.c_str(),
+                         port_string.c_str(), &hints);
+    if (err < 0) {
+      if (out_ != NULL) {
+        fprintf(out_, "Unable to resolve \"%s\": %s\n", host_.c_str(),
+                uv_strerror(err));
+      }
+      return false;
     }
-    return false;
-  }
-  for (addrinfo* address = req.addrinfo; address != nullptr;
-       address = address->ai_next) {
-    err = ServerSocket::Listen(this, address->ai_addr, loop_);
+    for (addrinfo* address = req.addrinfo; address != nullptr;
+         address = address->ai_next) {
+      err = ServerSocket::Listen(this, address->ai_addr, loop_, options_);
+    }
+    uv_freeaddrinfo(req.addrinfo);
   }
-  uv_freeaddrinfo(req.addrinfo);
 
   if (!connected_sessions_.empty()) {
     return true;
@@ -449,6 +692,8 @@ bool InspectorSocketServer::Start() {
     return false;
   }
   state_ = ServerState::kRunning;
+  StartIoLoops();
+  StartAcceptors();
   // getaddrinfo sorts the addresses, so the first port is most relevant.
   PrintDebuggerReadyMessage(host_, server_sockets_[0]->port(),
                             delegate_->GetTargetIds(), out_);
@@ -463,14 +708,50 @@ void InspectorSocketServer::Stop(ServerCallback cb) {
   closer_->AddCallback(cb);
   closer_->IncreaseExpectedCount();
   state_ = ServerState::kStopping;
+  StopAcceptors();
+  CancelFileTransfers();
   for (ServerSocket* server_socket : server_sockets_)
     server_socket->Close();
   closer_->NotifyIfDone();
 }
 
+void InspectorSocketServer::CancelFileTransfers() {
+  std::lock_guard<std::mutex> guard(sessions_lock_);
+  for (SocketSession* session : streaming_sessions_) {
+    if (session->OnCurrentLoop()) {
+      session->CancelSendFile();
+    } else {
+      session->io_loop()->Post([this, session]() {
+        std::lock_guard<std::mutex> guard(sessions_lock_);
+        if (streaming_sessions_.count(session) != 0)
+          session->CancelSendFile();
+      });
+    }
+  }
+}
+
 void InspectorSocketServer::TerminateConnections() {
+  std::lock_guard<std::mutex> guard(sessions_lock_);
   for (const auto& session : connected_sessions_) {
-    session.second->Close();
+    if (session.second->OnCurrentLoop()) {
+      session.second->Close();
+    } else {
+      int session_id = session.first;
+      session.second->io_loop()->Post([this, session_id]() {
+        TerminateSession(session_id);
+      });
+    }
+  }
+}
+
+void InspectorSocketServer::TerminateSession(int session_id) {
+  IoLoop* io_loop = nullptr;
+  SocketSession* session = SessionOnCurrentLoop(session_id, &io_loop);
+  if (session != nullptr) {
+    if (!session->IsClosing())
+      session->Close();
+  } else if (io_loop != nullptr) {
+    io_loop->Post([this, session_id]() { TerminateSession(session_id); });
   }
 }
 
@@ -480,10 +761,157 @@ bool InspectorSocketServer::TargetExists(const std::string& id) {
   return found != target_ids.end();
 }
 
+// Sessions are only touched on their own loop, which is the one that may
+// delete them. Sends from other threads are posted there.
 void InspectorSocketServer::Send(int session_id, const std::string& message) {
+  IoLoop* io_loop = nullptr;
+  SocketSession* session = SessionOnCurrentLoop(session_id, &io_loop);
+  if (session != nullptr) {
+    session->Send(message);
+  } else if (io_loop != nullptr) {
+    std::vector<std::string> messages;
+    messages.push_back(message);
+    PostSend(io_loop, session_id, std::move(messages));
+  }
+}
+
+void InspectorSocketServer::Send(int session_id,
+                                 std::vector<std::string> messages) {
+  IoLoop* io_loop = nullptr;
+  SocketSession* session = SessionOnCurrentLoop(session_id, &io_loop);
+  if (session != nullptr)
+    session->Send(std::move(messages));
+  else if (io_loop != nullptr)
+    PostSend(io_loop, session_id, std::move(messages));
+}
+
+SocketSession* InspectorSocketServer::SessionOnCurrentLoop(int session_id,
+                                                           IoLoop** io_loop) {
+  std::lock_guard<std::mutex> guard(sessions_lock_);
   auto session_iterator = connected_sessions_.find(session_id);
-  if (session_iterator != connected_sessions_.end()) {
-    session_iterator->second->Send(message);
+  if (session_iterator == connected_sessions_.end())
+    return nullptr;
+  SocketSession* session = session_iterator->second;
+  if (session->OnCurrentLoop())
+    return session;
+  *io_loop = session->io_loop();
+  return nullptr;
+}
+
+void InspectorSocketServer::PostSend(IoLoop* io_loop, int session_id,
+                                     std::vector<std::string> messages) {
+  // std::function needs a copyable task.
+  auto shared_messages =
+      std::make_shared<std::vector<std::string>>(std::move(messages));
+  io_loop->Post([this, session_id, shared_messages]() {
+    Send(session_id, std::move(*shared_messages));
+  });
+}
+
+void InspectorSocketServer::StartIoLoops() {
+  if (options_.io_loops <= 1 && options_.acceptors <= 1)
+    return;
+  io_loops_.push_back(IoLoop::Wrap(loop_));
+  for (int i = 1; i < options_.io_loops; i++)
+    io_loops_.push_back(IoLoop::Spawn());
+}
+
+void InspectorSocketServer::StopIoLoops() {
+  for (IoLoop* io_loop : io_loops_)
+    io_loop->Shutdown();
+}
+
+// The server loop also runs the server's timers and the queue written from
+// the isolate thread, so it only serves sessions when it is the only loop.
+IoLoop* InspectorSocketServer::PickIoLoop(uv_os_sock_t fd) {
+  if (io_loops_.size() == 1)
+    return io_loops_[0];
+  size_t spawned = io_loops_.size() - 1;
+  if (options_.io_loop_policy == IoLoopPolicy::kHash)
+    return io_loops_[1 + HashPeerAddress(fd) % spawned];
+  IoLoop* least_loaded = io_loops_[1];
+  for (size_t i = 2; i < io_loops_.size(); i++) {
+    if (io_loops_[i]->load() < least_loaded->load())
+      least_loaded = io_loops_[i];
+  }
+  return least_loaded;
+}
+
+int InspectorSocketServer::CurrentIoLoop() const {
+  for (size_t i = 0; i < io_loops_.size(); i++) {
+    if (io_loops_[i]->IsCurrent())
+      return i;
+  }
+  return -1;
+}
+
+bool InspectorSocketServer::PostToIoLoop(int index,
+                                         std::function<void()> task) {
+  return io_loops_[index]->Post(std::move(task));
+}
+
+void InspectorSocketServer::Accept(int server_port,
+                                   uv_stream_t* server_socket) {
+  if (io_loops_.size() <= 1) {
+    IoLoop* io_loop = io_loops_.empty() ? nullptr : io_loops_[0];
+    // Memory is freed when the socket closes.
+    SocketSession::Accept(this, server_port, server_socket, io_loop);
+    return;
+  }
+  // The connection is detached from the server loop, so that it can be
+  // opened on another one.
+  uv_tcp_t* client = new uv_tcp_t;
+  int err = uv_tcp_init(loop_, client);
+  assert(err == 0);
+  uv_os_fd_t fd = -1;
+  if (uv_accept(server_socket, reinterpret_cast<uv_stream_t*>(client)) == 0 &&
+      uv_fileno(reinterpret_cast<uv_handle_t*>(client), &fd) == 0) {
+    fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  }
+  uv_close(reinterpret_cast<uv_handle_t*>(client), FreeTcpOnClose);
+  if (fd >= 0)
+    HandOffConnection(fd, server_port);
+}
+
+void InspectorSocketServer::StartAcceptors() {
+  if (options_.acceptors <= 1)
+    return;
+  for (ServerSocket* server_socket : server_sockets_) {
+    sockaddr_storage addr;
+    if (server_socket->GetAddress(&addr) != 0)
+      continue;
+    for (int i = 1; i < options_.acceptors; i++) {
+      Acceptor* acceptor = Acceptor::Start(this, addr, server_socket->port(),
+                                           options_.backlog);
+      if (acceptor == nullptr)
+        break;
+      acceptors_.push_back(acceptor);
+    }
+  }
+}
+
+void InspectorSocketServer::StopAcceptors() {
+  if (options_.acceptors <= 1)
+    return;
+  for (Acceptor* acceptor : acceptors_) {
+    acceptor->Stop();
+    delete acceptor;
+  }
+  acceptors_.clear();
+}
+
+void InspectorSocketServer::HandOffConnection(uv_os_sock_t fd,
+                                              int server_port) {
+  IoLoop* io_loop = PickIoLoop(fd);
+  // Counted right away, so that a burst of connections is spread out.
+  io_loop->AddLoad();
+  bool posted = io_loop->Post([this, io_loop, fd, server_port]() {
+    // Memory is freed when the socket closes.
+    SocketSession::Open(this, server_port, io_loop, fd);
+  });
+  if (!posted) {
+    io_loop->RemoveLoad();
+    close(fd);
   }
 }
 
@@ -503,8 +931,8 @@ void InspectorSocketServer::ServerSocketClosed(ServerSocket* server_socket) {
   if (closer_ != nullptr) {
     closer_->DecreaseExpectedCount();
   }
-  if (connected_sessions_.empty()) {
-    delegate_->ServerDone();
+  if (!HasSessions()) {
+    Done();
   }
   state_ = ServerState::kStopped;
 }
@@ -520,6 +948,7 @@ int InspectorSocketServer::Port() const {
 SocketSession::SocketSession(InspectorSocketServer* server, int server_port)
                              : id_(server->GenerateSessionId()),
                                server_(server),
+                               io_loop_(nullptr),
                                state_(State::kHttp),
                                server_port_(server_port) { }
 
@@ -531,15 +960,28 @@ void SocketSession::Close() {
 
 // static
 int SocketSession::Accept(InspectorSocketServer* server, int server_port,
-                          uv_stream_t* server_socket) {
-  // Memory is freed when the socket closes.
+                          uv_stream_t* server_socket, IoLoop* io_loop) {
+  // Memory is freed when the socket closes, or its setup fails.
   SocketSession* session = new SocketSession(server, server_port);
-  int err = inspector_accept(server_socket, &session->socket_,
-                             HandshakeCallback);
-  if (err != 0) {
-    delete session;
+  if (io_loop != nullptr) {
+    session->io_loop_ = io_loop;
+    io_loop->AddLoad();
+    io_loop->AddSession(session);
   }
-  return err;
+  return inspector_accept(server_socket, &session->socket_,
+                          HandshakeCallback);
+}
+
+// static
+int SocketSession::Open(InspectorSocketServer* server, int server_port,
+                        IoLoop* io_loop, uv_os_sock_t fd) {
+  // Memory is freed when the socket closes, or its setup fails. Either way
+  // SessionTerminated() releases the load counted by the caller.
+  SocketSession* session = new SocketSession(server, server_port);
+  session->io_loop_ = io_loop;
+  io_loop->AddSession(session);
+  return inspector_open(io_loop->loop(), fd, &session->socket_,
+                        HandshakeCallback);
 }
 
 // static
@@ -553,8 +995,9 @@ bool SocketSession::HandshakeCallback(InspectorSocket* socket,
   case kInspectorHandshakeHttpGet:
     return server->HandleGetRequest(socket, path);
   case kInspectorHandshakeUpgrading:
+    // Set before the session is visible to other IO loops.
+    session->SetTargetId(id);
     if (server->SessionStarted(session, id)) {
-      session->SetTargetId(id);
       return true;
     } else {
       session->SetDeclined();
@@ -604,6 +1047,10 @@ void SocketSession::Send(const std::string& message) {
   inspector_write(&socket_, message.data(), message.length());
 }
 
+void SocketSession::Send(std::vector<std::string> messages) {
+  inspector_write_frames(&socket_, std::move(messages));
+}
+
 // ServerSocket implementation
 int ServerSocket::DetectPort() {
   sockaddr_storage addr;
@@ -621,15 +1068,43 @@ int ServerSocket::DetectPort() {
   return err;
 }
 
+int ServerSocket::GetAddress(sockaddr_storage* addr) const {
+  int len = sizeof(*addr);
+  return uv_tcp_getsockname(&tcp_socket_,
+                            reinterpret_cast<struct sockaddr*>(addr), &len);
+}
+
 // static
 int ServerSocket::Listen(InspectorSocketServer* inspector_server,
-                         sockaddr* addr, uv_loop_t* loop) {
+                         sockaddr* addr, uv_loop_t* loop,
+                         const ServerSocketOptions& options) {
   ServerSocket* server_socket = new ServerSocket(inspector_server);
   uv_tcp_t* server = &server_socket->tcp_socket_;
-  assert(0 == uv_tcp_init(loop, server));
-  int err = uv_tcp_bind(server, addr, 0);
+  int err = 0;
+  if (options.reuse_port || options.acceptors > 1) {
+    // The option has to be set before bind(), so the socket is created
+    // upfront.
+    err = uv_tcp_init_ex(loop, server, addr->sa_family);
+    assert(err == 0);
+#ifdef SO_REUSEPORT
+    uv_os_fd_t fd;
+    int on = 1;
+    err = uv_fileno(reinterpret_cast<uv_handle_t*>(server), &fd);
+    if (err == 0 &&
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0) {
+      err = -errno;
+    }
+#else
+    err = UV_ENOTSUP;
+#endif
+  } else {
+    assert(0 == uv_tcp_init(loop, server));
+  }
   if (err == 0) {
-    err = uv_listen(reinterpret_cast<uv_stream_t*>(server), 1,
+    err = uv_tcp_bind(server, addr, 0);
+  }
+  if (err == 0) {
+    err = uv_listen(reinterpret_cast<uv_stream_t*>(server), options.backlog,
                     ServerSocket::SocketConnectedCallback);
   }
   if (err == 0) {
@@ -648,9 +1123,7 @@ void ServerSocket::SocketConnectedCallback(uv_stream_t* tcp_socket,
                                            int status) {
   if (status == 0) {
     ServerSocket* server_socket = ServerSocket::FromTcpSocket(tcp_socket);
-    // Memory is freed when the socket closes.
-    SocketSession::Accept(server_socket->server_, server_socket->port_,
-                          tcp_socket);
+    server_socket->server_->Accept(server_socket->port_, tcp_socket);
   }
 }
 
@@ -661,4 +1134,184 @@ void ServerSocket::SocketClosedCallback(uv_handle_t* tcp_socket) {
   delete server_socket;
 }
 
+// Acceptor implementation
+// static
+Acceptor* Acceptor::Start(InspectorSocketServer* server,
+                          const sockaddr_storage& addr, int port,
+                          int backlog) {
+#if HAVE_REUSEPORT_ACCEPTORS
+  int fd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                  0);
+  if (fd < 0)
+    return nullptr;
+  int on = 1;
+  socklen_t len = addr.ss_family == AF_INET6 ? sizeof(sockaddr_in6)
+                                             : sizeof(sockaddr_in);
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+      setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0 ||
+      bind(fd, reinterpret_cast<const sockaddr*>(&addr), len) != 0 ||
+      listen(fd, backlog) != 0) {
+    close(fd);
+    return nullptr;
+  }
+  Acceptor* acceptor = new Acceptor(server, port);
+  acceptor->fd_ = fd;
+  int err = uv_loop_init(&acceptor->loop_);
+  assert(err == 0);
+  err = uv_poll_init_socket(&acceptor->loop_, &acceptor->poll_, fd);
+  assert(err == 0);
+  err = uv_poll_start(&acceptor->poll_, UV_READABLE, PollCallback);
+  assert(err == 0);
+  err = uv_async_init(&acceptor->loop_, &acceptor->stop_async_, StopCallback);
+  assert(err == 0);
+  err = uv_thread_create(&acceptor->thread_, ThreadMain, acceptor);
+  assert(err == 0);
+  return acceptor;
+#else
+  return nullptr;
+#endif
+}
+
+void Acceptor::Stop() {
+  int err = uv_async_send(&stop_async_);
+  assert(err == 0);
+  err = uv_thread_join(&thread_);
+  assert(err == 0);
+  err = uv_loop_close(&loop_);
+  assert(err == 0);
+  close(fd_);
+}
+
+// static
+void Acceptor::ThreadMain(void* acceptor) {
+  Acceptor* self = static_cast<Acceptor*>(acceptor);
+  uv_run(&self->loop_, UV_RUN_DEFAULT);
+}
+
+// static
+void Acceptor::PollCallback(uv_poll_t* poll, int status, int events) {
+  Acceptor* acceptor = ContainerOf(&Acceptor::poll_, poll);
+  if (status != 0)
+    return;
+#if HAVE_REUSEPORT_ACCEPTORS
+  for (;;) {
+    int fd = accept4(acceptor->fd_, nullptr, nullptr,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      break;  // EAGAIN, or out of descriptors until some are released.
+    }
+    acceptor->server_->HandOffConnection(fd, acceptor->port_);
+  }
+#endif
+}
+
+// static
+void Acceptor::StopCallback(uv_async_t* async) {
+  Acceptor* acceptor = ContainerOf(&Acceptor::stop_async_, async);
+  uv_close(reinterpret_cast<uv_handle_t*>(&acceptor->poll_), nullptr);
+  uv_close(reinterpret_cast<uv_handle_t*>(&acceptor->stop_async_), nullptr);
+}
+
+// IoLoop implementation
+// static
+IoLoop* IoLoop::Wrap(uv_loop_t* loop) {
+  IoLoop* io_loop = new IoLoop();
+  io_loop->loop_ = loop;
+  int err = uv_async_init(loop, &io_loop->async_, AsyncCallback);
+  assert(err == 0);
+  io_loop->thread_ = uv_thread_self();
+  return io_loop;
+}
+
+// static
+IoLoop* IoLoop::Spawn() {
+  IoLoop* io_loop = new IoLoop();
+  io_loop->loop_ = &io_loop->own_loop_;
+  io_loop->owns_loop_ = true;
+  int err = uv_loop_init(io_loop->loop_);
+  assert(err == 0);
+  err = uv_async_init(io_loop->loop_, &io_loop->async_, AsyncCallback);
+  assert(err == 0);
+  err = uv_thread_create(&io_loop->thread_, ThreadMain, io_loop);
+  assert(err == 0);
+  return io_loop;
+}
+
+bool IoLoop::Post(std::function<void()> task) {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (closed_)
+    return false;
+  bool wake = tasks_.empty();
+  tasks_.push_back(std::move(task));
+  // Sent under the lock, as the handle is closed once closed_ is set.
+  if (wake)
+    uv_async_send(&async_);
+  return true;
+}
+
+bool IoLoop::IsCurrent() const {
+  uv_thread_t self = uv_thread_self();
+  return uv_thread_equal(&thread_, &self) != 0;
+}
+
+void IoLoop::Shutdown() {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    closed_ = true;
+    if (owns_loop_) {
+      uv_async_send(&async_);
+      return;
+    }
+  }
+  RunTasks();
+  uv_close(reinterpret_cast<uv_handle_t*>(&async_), nullptr);
+}
+
+void IoLoop::Join() {
+  if (!owns_loop_)
+    return;
+  int err = uv_thread_join(&thread_);
+  assert(err == 0);
+}
+
+bool IoLoop::RunTasks() {
+  std::vector<std::function<void()>> tasks;
+  bool closed;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    tasks.swap(tasks_);
+    closed = closed_;
+  }
+  for (const auto& task : tasks)
+    task();
+  return closed;
+}
+
+// static
+void IoLoop::ThreadMain(void* io_loop) {
+  IoLoop* self = static_cast<IoLoop*>(io_loop);
+  uv_run(self->loop_, UV_RUN_DEFAULT);
+  // The handles of the sessions left were closed by AsyncCallback.
+  for (SocketSession* session : self->sessions_)
+    delete session;
+  self->sessions_.clear();
+  int err = uv_loop_close(self->loop_);
+  assert(err == 0);
+}
+
+// static
+void IoLoop::AsyncCallback(uv_async_t* async) {
+  IoLoop* io_loop = ContainerOf(&IoLoop::async_, async);
+  if (io_loop->RunTasks() && io_loop->owns_loop_)
+    uv_walk(io_loop->loop_, CloseHandle, nullptr);
+}
+
+// static
+void IoLoop::CloseHandle(uv_handle_t* handle, void* arg) {
+  if (!uv_is_closing(handle))
+    uv_close(handle, nullptr);
+}
+
 }  // namespace inspector
@@ -27,16 +27,51 @@
 #include "inspector_socket.h"
 #include "uv.h"
 
+#include <atomic>
+#include <functional>
 #include <map>
+#include <mutex>
+#include <set>
 #include <string>
 #include <vector>
 
 namespace inspector {
 
+class Acceptor;
 class Closer;
+class IoLoop;
 class SocketSession;
 class ServerSocket;
 
+// How sessions are spread over the IO loops.
+enum class IoLoopPolicy {
+  // The loop with the fewest sessions.
+  kLeastLoaded,
+  // A hash of the peer address, so a client keeps landing on the same loop.
+  kHash
+};
+
+struct ServerSocketOptions {
+  ServerSocketOptions() : backlog(511), acceptors(1), reuse_port(false),
+                          io_loops(1),
+                          io_loop_policy(IoLoopPolicy::kLeastLoaded) { }
+  // Backlog passed to listen() for every listening socket.
+  int backlog;
+  // Number of listening sockets per address. Sockets beyond the first accept
+  // on their own threads and hand connections over to the IO loops, with
+  // the kernel spreading incoming connections between them (SO_REUSEPORT).
+  int acceptors;
+  // Sets SO_REUSEPORT, so that other processes may listen on the same port.
+  // Implied when acceptors > 1.
+  bool reuse_port;
+  // Number of loops serving sessions, including the server loop. Each extra
+  // loop runs on its own thread and does the framing and writes for the
+  // sessions assigned to it. With extra loops, the server loop only accepts
+  // connections and hands them over.
+  int io_loops;
+  IoLoopPolicy io_loop_policy;
+};
+
 class SocketServerDelegate {
  public:
   virtual bool StartSession(int session_id, const std::string& target_id) = 0;
@@ -45,6 +80,11 @@ class SocketServerDelegate {
   virtual std::vector<std::string> GetTargetIds() = 0;
   virtual std::string GetTargetTitle(const std::string& id) = 0;
   virtual std::string GetTargetUrl(const std::string& id) = 0;
+  // A JSON object served at /json/metrics
+  virtual std::string GetMetrics() = 0;
+  // The file behind an IO stream handle, served at /json/stream/<handle>.
+  // Returns a descriptor the server closes, or -1 if there is no such stream.
+  virtual int OpenStreamFile(const std::string& handle, int64_t* size) = 0;
   virtual void ServerDone() = 0;
 };
 
@@ -60,20 +100,34 @@ class InspectorSocketServer {
                         uv_loop_t* loop,
                         const std::string& host,
                         int port,
-                        FILE* out = stderr);
+                        FILE* out = stderr,
+                        const ServerSocketOptions& options =
+                            ServerSocketOptions());
+  ~InspectorSocketServer();
   // Start listening on host/port
   bool Start();
 
   // Called by the TransportAction sent with InspectorIo::Write():
   //   kKill and kStop
   void Stop(ServerCallback callback);
-  //   kSendMessage
+  //   kSendMessage. Both overloads may be called from any IO loop.
   void Send(int session_id, const std::string& message);
+  //   kSendMessage, for consecutive messages to the same session
+  void Send(int session_id, std::vector<std::string> messages);
   //   kKill
   void TerminateConnections();
+  // Closes one WS session. May be called from any IO loop.
+  void TerminateSession(int session_id);
 
   int Port() const;
 
+  // The index of the IO loop the calling thread runs, or -1 if there is
+  // none. Lets outgoing messages be queued per loop.
+  int CurrentIoLoop() const;
+  // Runs task on the IO loop at index. May be called from any thread, and
+  // returns false, dropping the task, once the loop is shutting down.
+  bool PostToIoLoop(int index, std::function<void()> task);
+
   // Server socket lifecycle. There may be multiple sockets
   void ServerSocketListening(ServerSocket* server_socket);
   void ServerSocketClosed(ServerSocket* server_socket);
@@ -90,9 +144,34 @@ class InspectorSocketServer {
     return next_session_id_++;
   }
 
+  const ServerSocketOptions& options() const { return options_; }
+
+  // Called by ServerSocket with a pending connection on server_port.
+  void Accept(int server_port, uv_stream_t* server_socket);
+  // Opens a connection accepted on server_port, on an IO loop picked by the
+  // policy. Called from the server loop and from Acceptor threads.
+  void HandOffConnection(uv_os_sock_t fd, int server_port);
+
  private:
   void SendListResponse(InspectorSocket* socket);
   bool TargetExists(const std::string& id);
+  void StartIoLoops();
+  void StopIoLoops();
+  IoLoop* PickIoLoop(uv_os_sock_t fd);
+  void StartAcceptors();
+  void StopAcceptors();
+  // Ends the /json/stream responses still being sent, so that a slow peer
+  // does not hold up the loop they are on.
+  void CancelFileTransfers();
+  // Server loop side of SessionTerminated() for WS sessions
+  void SessionEnded(int session_id);
+  bool HasSessions();
+  void Done();
+  // Returns the session if it may be used on this thread. Otherwise sets
+  // *io_loop to the loop it lives on, if it exists.
+  SocketSession* SessionOnCurrentLoop(int session_id, IoLoop** io_loop);
+  void PostSend(IoLoop* io_loop, int session_id,
+                std::vector<std::string> messages);
 
   enum class ServerState {kNew, kRunning, kStopping, kStopped};
   uv_loop_t* loop_;
@@ -102,10 +181,23 @@ class InspectorSocketServer {
   std::string path_;
   std::vector<ServerSocket*> server_sockets_;
   Closer* closer_;
+  // Sessions may live on any IO loop; sessions_lock_ guards
+  // connected_sessions_, ending_sessions_ and streaming_sessions_.
+  std::mutex sessions_lock_;
   std::map<int, SocketSession*> connected_sessions_;
-  int next_session_id_;
+  // HTTP sessions that were sent a file, until they close
+  std::set<SocketSession*> streaming_sessions_;
+  // WS sessions already closed whose SessionEnded() has not run yet
+  int ending_sessions_;
+  std::atomic<int> next_session_id_;
   FILE* out_;
   ServerState state_;
+  bool done_;
+  const ServerSocketOptions options_;
+  std::vector<Acceptor*> acceptors_;
+  // Empty unless connections are handed between threads. io_loops_[0] is the
+  // server loop.
+  std::vector<IoLoop*> io_loops_;
 
   friend class Closer;
 };
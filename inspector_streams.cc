@@ -0,0 +1,306 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#include "inspector_streams.h"
+
+#include "base64.h"
+#include "inspector_json.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <vector>
+
+namespace inspector {
+
+namespace {
+
+// pread() granularity. A multiple of 3, so that only the last block of a
+// chunk can leave bytes in the base64 carry.
+const size_t kReadBlockSize = 48 * 1024;
+
+// Length of the longest prefix of data that does not end in the middle of a
+// UTF-8 sequence.
+size_t Utf8CompletePrefix(const char* data, size_t len) {
+  size_t back = 0;
+  while (back < len && back < 4) {
+    const unsigned char c = static_cast<unsigned char>(data[len - back - 1]);
+    back++;
+    if ((c & 0xC0) != 0x80) {
+      size_t expected = 1;
+      if ((c & 0xE0) == 0xC0)
+        expected = 2;
+      else if ((c & 0xF0) == 0xE0)
+        expected = 3;
+      else if ((c & 0xF8) == 0xF0)
+        expected = 4;
+      return back < expected ? len - back : len;
+    }
+  }
+  return len;
+}
+
+// Reads up to len bytes at offset, stopping early only at the end of the
+// file or on an error. Returns how many bytes were read.
+size_t PreadFully(int fd, char* data, size_t len, int64_t offset) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t got = pread(fd, data + done, len - done, offset + done);
+    if (got < 0 && errno == EINTR)
+      continue;
+    if (got <= 0)
+      break;
+    done += got;
+  }
+  return done;
+}
+
+}  // namespace
+
+struct InspectorStreams::Stream {
+  Stream(int fd, const std::string& path, bool base64_encoded,
+         bool delete_on_close) : fd(fd), path(path),
+                                 base64_encoded(base64_encoded),
+                                 delete_on_close(delete_on_close),
+                                 position(0) {}
+  ~Stream() {
+    close(fd);
+    if (delete_on_close)
+      unlink(path.c_str());
+  }
+
+  const int fd;
+  const std::string path;
+  const bool base64_encoded;
+  const bool delete_on_close;
+  // Guards position; reads of one stream are served one at a time.
+  std::mutex lock;
+  int64_t position;
+};
+
+InspectorStreams::InspectorStreams() : next_handle_(1) { }
+
+InspectorStreams::~InspectorStreams() {
+  CloseAll();
+}
+
+std::string InspectorStreams::Open(const std::string& path,
+                                   bool base64_encoded,
+                                   bool delete_on_close) {
+  int fd;
+  do {
+    fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0)
+    return std::string();
+  std::shared_ptr<Stream> stream = std::make_shared<Stream>(
+      fd, path, base64_encoded, delete_on_close);
+  std::lock_guard<std::mutex> guard(lock_);
+  std::string handle = "stream-" + std::to_string(next_handle_++);
+  streams_[handle] = stream;
+  return handle;
+}
+
+bool InspectorStreams::Close(const std::string& handle) {
+  std::shared_ptr<Stream> stream;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    auto it = streams_.find(handle);
+    if (it == streams_.end())
+      return false;
+    stream = std::move(it->second);
+    streams_.erase(it);
+  }
+  // The file is closed here, or by a read still in flight once it finishes.
+  return true;
+}
+
+void InspectorStreams::CloseAll() {
+  std::map<std::string, std::shared_ptr<Stream>> streams;
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    streams.swap(streams_);
+  }
+}
+
+int InspectorStreams::DuplicateFile(const std::string& handle,
+                                    int64_t* size) {
+  std::shared_ptr<Stream> stream = Find(handle);
+  if (stream == nullptr)
+    return -1;
+  int fd = fcntl(stream->fd, F_DUPFD_CLOEXEC, 0);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  *size = st.st_size;
+  return fd;
+}
+
+std::shared_ptr<InspectorStreams::Stream> InspectorStreams::Find(
+    const std::string& handle) {
+  std::lock_guard<std::mutex> guard(lock_);
+  auto it = streams_.find(handle);
+  return it == streams_.end() ? nullptr : it->second;
+}
+
+bool InspectorStreams::Read(Stream* stream, int64_t offset, size_t size,
+                            std::string* response) {
+  std::lock_guard<std::mutex> guard(stream->lock);
+  if (offset >= 0)
+    stream->position = offset;
+  struct stat st;
+  if (fstat(stream->fd, &st) != 0)
+    return false;
+  int64_t remaining = st.st_size - stream->position;
+  if (remaining < 0)
+    remaining = 0;
+  if (static_cast<uint64_t>(remaining) < size)
+    size = static_cast<size_t>(remaining);
+  // Keep base64 chunks free of padding so they can be concatenated.
+  if (stream->base64_encoded && size > 3 &&
+      static_cast<int64_t>(size) < remaining) {
+    size -= size % 3;
+  }
+
+  std::vector<char> block(size < kReadBlockSize ? size : kReadBlockSize);
+  size_t done = 0;
+  if (stream->base64_encoded) {
+    response->append("\"base64Encoded\":true,\"data\":\"");
+    size_t data_start = response->size();
+    response->resize(data_start + base64_encoded_size(size));
+    char* dst = &(*response)[data_start];
+    size_t written = 0;
+    base64_stream_state state;
+    base64_stream_init(&state);
+    while (done < size) {
+      size_t want = size - done < block.size() ? size - done : block.size();
+      ssize_t got = pread(stream->fd, block.data(), want,
+                          stream->position + done);
+      if (got < 0 && errno == EINTR)
+        continue;
+      if (got <= 0)
+        break;
+      size_t consumed;
+      written += base64_stream_encode(&state, block.data(), got, &consumed,
+                                      dst + written,
+                                      base64_encoded_size(size) - written);
+      done += got;
+    }
+    written += base64_stream_finish(&state, dst + written,
+                                    base64_encoded_size(size) - written);
+    response->resize(data_start + written);
+    response->push_back('"');
+  } else {
+    std::vector<char> data(size);
+    done = PreadFully(stream->fd, data.data(), size, stream->position);
+    if (static_cast<int64_t>(done) < remaining) {
+      size_t complete = Utf8CompletePrefix(data.data(), done);
+      // A chunk smaller than the character at the current position would
+      // never move the position; widen it to take the whole character.
+      if (complete == 0 && done > 0) {
+        size_t want = done + 3;
+        if (static_cast<int64_t>(want) > remaining)
+          want = static_cast<size_t>(remaining);
+        data.resize(want);
+        done += PreadFully(stream->fd, data.data() + done, want - done,
+                           stream->position + done);
+        if (static_cast<int64_t>(done) < remaining)
+          complete = Utf8CompletePrefix(data.data(), done);
+        else
+          complete = done;
+        // Not valid UTF-8; pass the bytes through rather than stall.
+        if (complete == 0)
+          complete = done;
+      }
+      done = complete;
+    }
+    response->append("\"data\":");
+    AppendJsonString(response, data.data(), done);
+  }
+  stream->position += done;
+  response->append(",\"eof\":");
+  response->append(stream->position >= st.st_size ? "true" : "false");
+  return true;
+}
+
+bool InspectorStreams::HandleProtocolMessage(
+    const ProtocolEnvelope& envelope, std::string* response) {
+  bool is_read = envelope.method == "IO.read";
+  if (!is_read && envelope.method != "IO.close")
+    return false;
+  if (!envelope.has_id)
+    return false;
+  int64_t id = envelope.id;
+
+  std::string handle;
+  int64_t offset = -1;
+  int64_t size = kDefaultChunkSize;
+  if (envelope.params != nullptr) {
+    JsonObjectScanner params(envelope.params, envelope.params_length);
+    while (params.Next()) {
+      if (params.KeyIs("handle"))
+        JsonStringValue(params.value(), params.value_length(), &handle);
+      else if (params.KeyIs("offset"))
+        JsonIntegerValue(params.value(), params.value_length(), &offset);
+      else if (params.KeyIs("size"))
+        JsonIntegerValue(params.value(), params.value_length(), &size);
+    }
+  }
+  std::shared_ptr<Stream> stream = Find(handle);
+  if (stream == nullptr) {
+    MakeErrorResponse(response, id, kProtocolInvalidParams,
+                      "Invalid stream handle");
+    return true;
+  }
+
+  if (!is_read) {
+    stream.reset();
+    Close(handle);
+    response->clear();
+    AppendResponsePrefix(response, id);
+    response->append(",\"result\":{}}");
+    return true;
+  }
+
+  if (size <= 0)
+    size = kDefaultChunkSize;
+  else if (static_cast<uint64_t>(size) > kMaxChunkSize)
+    size = kMaxChunkSize;
+  response->clear();
+  AppendResponsePrefix(response, id);
+  response->append(",\"result\":{");
+  if (!Read(stream.get(), offset, static_cast<size_t>(size), response)) {
+    MakeErrorResponse(response, id, kProtocolServerError, "Stream read failed");
+    return true;
+  }
+  response->append("}}");
+  return true;
+}
+
+}  // namespace inspector
@@ -0,0 +1,86 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#ifndef SRC_INSPECTOR_STREAMS_H_
+#define SRC_INSPECTOR_STREAMS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace inspector {
+
+struct ProtocolEnvelope;
+
+// File-backed streams handed out to the frontend as IO domain stream handles
+// (IO.read / IO.close). Profiles, snapshots and traces are written to disk
+// and then pulled by the frontend in chunks, instead of being inlined in a
+// protocol message. All methods are thread-safe. Reads use pread() and are
+// answered on the inspector IO thread; the isolate thread is never involved.
+class InspectorStreams {
+ public:
+  // Used when IO.read does not specify a size.
+  static const size_t kDefaultChunkSize = 1 << 20;
+  // Upper bound on the size of a single IO.read chunk.
+  static const size_t kMaxChunkSize = 16 << 20;
+
+  InspectorStreams();
+  ~InspectorStreams();
+
+  // Opens the file at path and returns its stream handle, or an empty string
+  // if the file could not be opened. Binary files should be base64 encoded.
+  // If delete_on_close is set the file is removed when the stream is closed.
+  std::string Open(const std::string& path, bool base64_encoded,
+                   bool delete_on_close);
+  // Returns false if there is no such stream.
+  bool Close(const std::string& handle);
+  void CloseAll();
+  // Returns a new descriptor for the stream's file, which the caller closes,
+  // and sets *size to the file's size. Returns -1 if there is no such stream.
+  // Reads through it do not move the stream's IO.read position.
+  int DuplicateFile(const std::string& handle, int64_t* size);
+
+  // If the message is an IO.read or IO.close request, answers it into
+  // *response and returns true. Other messages are left to V8.
+  bool HandleProtocolMessage(const ProtocolEnvelope& envelope,
+                             std::string* response);
+
+ private:
+  struct Stream;
+
+  std::shared_ptr<Stream> Find(const std::string& handle);
+  // Appends the "result" object of an IO.read response to *response.
+  bool Read(Stream* stream, int64_t offset, size_t size,
+            std::string* response);
+
+  std::mutex lock_;
+  std::map<std::string, std::shared_ptr<Stream>> streams_;
+  int next_handle_;
+};
+
+}  // namespace inspector
+
+#endif  // SRC_INSPECTOR_STREAMS_H_
@@ -0,0 +1,73 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#include "inspector_util.h"
+
+#include "uv.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+
+namespace inspector {
+
+namespace {
+
+const double kNanosPerSecond = 1e9;
+
+}  // namespace
+
+TokenBucket::TokenBucket(double burst) : tokens_(burst),
+                                         refilled_at_(uv_hrtime()) { }
+
+bool TokenBucket::Take(double max_per_second, double burst) {
+  if (max_per_second == 0)
+    return true;
+  uint64_t now = uv_hrtime();
+  tokens_ = std::min(burst, tokens_ + (now - refilled_at_) * max_per_second /
+                                          kNanosPerSecond);
+  refilled_at_ = now;
+  if (tokens_ < 1)
+    return false;
+  tokens_ -= 1;
+  return true;
+}
+
+void TokenBucket::Limit(double burst) {
+  tokens_ = std::min(tokens_, burst);
+}
+
+bool WriteFileAtomically(const std::string& path, const std::string& data) {
+  std::string temp_path = path + ".tmp";
+  FILE* file = fopen(temp_path.c_str(), "wb");
+  if (file == nullptr)
+    return false;
+  bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+  ok = fclose(file) == 0 && ok;
+  if (ok)
+    ok = rename(temp_path.c_str(), path.c_str()) == 0;
+  if (!ok)
+    remove(temp_path.c_str());
+  return ok;
+}
+
+}  // namespace inspector
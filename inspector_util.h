@@ -0,0 +1,56 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#ifndef SRC_INSPECTOR_UTIL_H_
+#define SRC_INSPECTOR_UTIL_H_
+
+#include <stdint.h>
+
+#include <string>
+
+namespace inspector {
+
+// Lets burst calls through back to back, and max_per_second on average after
+// that. The rate is passed on each call, so one setting can cover many
+// buckets. Not thread-safe.
+class TokenBucket {
+ public:
+  explicit TokenBucket(double burst);
+
+  // Refills the bucket and takes a token if there is one. A max_per_second
+  // of zero means no limit.
+  bool Take(double max_per_second, double burst);
+  // Drops the tokens above burst, after the burst has been lowered.
+  void Limit(double burst);
+
+ private:
+  double tokens_;
+  uint64_t refilled_at_;
+};
+
+// Writes data to path + ".tmp" and renames it over path, so readers never see
+// a partial file. Returns false, leaving nothing behind, on failure.
+bool WriteFileAtomically(const std::string& path, const std::string& data);
+
+}  // namespace inspector
+
+#endif  // SRC_INSPECTOR_UTIL_H_
@@ -0,0 +1,239 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#include "inspector_watchdog.h"
+
+#include "inspector_json.h"
+#include "uv.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace inspector {
+
+namespace {
+
+using namespace v8;
+
+const uint64_t kNanosPerMs = 1000 * 1000;
+
+// V8's call callbacks carry no data, and an isolate runs on one thread at a
+// time.
+thread_local SlowHandlerWatchdog* current_watchdog = nullptr;
+
+std::string ToUtf8(Local<String> value) {
+  if (value.IsEmpty())
+    return std::string();
+  String::Utf8Value utf8(value);
+  return *utf8 == nullptr ? std::string() : std::string(*utf8, utf8.length());
+}
+
+}  // namespace
+
+SlowHandlerWatchdog::SlowHandlerWatchdog() : isolate_(nullptr),
+                                             threshold_ms_(0),
+                                             running_since_(0),
+                                             last_interrupt_(0),
+                                             suspended_run_(false),
+                                             max_frames_(0),
+                                             max_samples_(0) { }
+
+SlowHandlerWatchdog::~SlowHandlerWatchdog() {
+  Disable();
+}
+
+void SlowHandlerWatchdog::Enable(Isolate* isolate, int threshold_ms,
+                                 int max_frames, size_t max_samples) {
+  Disable();
+  if (threshold_ms <= 0)
+    return;
+  isolate_ = isolate;
+  max_frames_ = max_frames;
+  max_samples_ = max_samples;
+  current_watchdog = this;
+  isolate_->AddBeforeCallEnteredCallback(BeforeCallEntered);
+  isolate_->AddCallCompletedCallback(CallCompleted);
+  threshold_ms_ = threshold_ms;
+}
+
+void SlowHandlerWatchdog::Disable() {
+  if (isolate_ == nullptr)
+    return;
+  threshold_ms_ = 0;
+  isolate_->RemoveBeforeCallEnteredCallback(BeforeCallEntered);
+  isolate_->RemoveCallCompletedCallback(CallCompleted);
+  if (current_watchdog == this)
+    current_watchdog = nullptr;
+  running_since_ = 0;
+  isolate_ = nullptr;
+}
+
+int SlowHandlerWatchdog::check_interval_ms() const {
+  int threshold_ms = threshold_ms_;
+  return threshold_ms == 0 ? 0 : std::max(threshold_ms / 4, 1);
+}
+
+// static
+void SlowHandlerWatchdog::BeforeCallEntered(Isolate* isolate) {
+  SlowHandlerWatchdog* watchdog = current_watchdog;
+  // Fires for every call into JS, only the outermost one starts a run.
+  if (watchdog != nullptr && watchdog->isolate_ == isolate &&
+      watchdog->running_since_ == 0) {
+    watchdog->running_since_ = uv_hrtime();
+  }
+}
+
+// static
+void SlowHandlerWatchdog::CallCompleted(Isolate* isolate) {
+  SlowHandlerWatchdog* watchdog = current_watchdog;
+  if (watchdog != nullptr && watchdog->isolate_ == isolate)
+    watchdog->running_since_ = 0;
+}
+
+void SlowHandlerWatchdog::Check() {
+  uint64_t threshold = threshold_ms_ * kNanosPerMs;
+  uint64_t running_since = running_since_;
+  if (threshold == 0 || running_since == 0)
+    return;
+  uint64_t now = uv_hrtime();
+  // One sample per threshold for as long as the run goes on
+  if (now - running_since < threshold || now - last_interrupt_ < threshold)
+    return;
+  last_interrupt_ = now;
+  isolate_->RequestInterrupt(Interrupt, this);
+}
+
+void SlowHandlerWatchdog::Suspend() {
+  // An interrupt already requested finds nothing running and does nothing.
+  suspended_run_ = running_since_.exchange(0) != 0;
+}
+
+void SlowHandlerWatchdog::Resume() {
+  if (suspended_run_ && isolate_ != nullptr)
+    running_since_ = uv_hrtime();
+  suspended_run_ = false;
+}
+
+// static
+void SlowHandlerWatchdog::Interrupt(Isolate* isolate, void* watchdog) {
+  static_cast<SlowHandlerWatchdog*>(watchdog)->TakeSample();
+}
+
+void SlowHandlerWatchdog::TakeSample() {
+  uint64_t running_since = running_since_;
+  if (running_since == 0 || isolate_ == nullptr)
+    return;
+  Sample sample;
+  sample.time_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  sample.running_ms = (uv_hrtime() - running_since) / kNanosPerMs;
+  HandleScope handle_scope(isolate_);
+  Local<StackTrace> stack = StackTrace::CurrentStackTrace(
+      isolate_, max_frames_, StackTrace::kOverview);
+  for (int i = 0; i < stack->GetFrameCount(); i++) {
+    Local<StackFrame> frame = stack->GetFrame(i);
+    std::string function_name = ToUtf8(frame->GetFunctionName());
+    sample.frames.push_back(
+        (function_name.empty() ? "(anonymous)" : function_name) + " (" +
+        ToUtf8(frame->GetScriptName()) + ":" +
+        std::to_string(frame->GetLineNumber()) + ":" +
+        std::to_string(frame->GetColumn()) + ")");
+  }
+  std::unique_lock<std::mutex> lock(lock_);
+  samples_.push_back(std::move(sample));
+  while (samples_.size() > max_samples_)
+    samples_.pop_front();
+}
+
+std::string SlowHandlerWatchdog::SamplesJson() {
+  std::unique_lock<std::mutex> lock(lock_);
+  std::string json = "[";
+  for (const Sample& sample : samples_) {
+    if (json.size() > 1)
+      json.push_back(',');
+    json.append("{\"time\":");
+    json.append(std::to_string(sample.time_ms));
+    json.append(",\"runningMs\":");
+    json.append(std::to_string(sample.running_ms));
+    json.append(",\"stack\":[");
+    for (size_t i = 0; i < sample.frames.size(); i++) {
+      if (i > 0)
+        json.push_back(',');
+      AppendJsonString(&json, sample.frames[i].data(),
+                       sample.frames[i].size());
+    }
+    json.append("]}");
+  }
+  json.push_back(']');
+  return json;
+}
+
+PauseWatchdog::PauseWatchdog() : max_pause_ms_(0) { }
+
+void PauseWatchdog::Stats::Add(uint64_t duration_ns, bool was_forced) {
+  count++;
+  if (was_forced)
+    forced++;
+  total_ns += duration_ns;
+  max_ns = std::max(max_ns, duration_ns);
+}
+
+void PauseWatchdog::Stats::AppendJson(std::string* json) const {
+  json->append("{\"count\":");
+  json->append(std::to_string(count));
+  json->append(",\"forcedResumes\":");
+  json->append(std::to_string(forced));
+  json->append(",\"totalMs\":");
+  json->append(std::to_string(total_ns / kNanosPerMs));
+  json->append(",\"maxMs\":");
+  json->append(std::to_string(max_ns / kNanosPerMs));
+  json->push_back('}');
+}
+
+void PauseWatchdog::Record(const std::string& reason, uint64_t duration_ns,
+                           bool forced) {
+  std::unique_lock<std::mutex> lock(lock_);
+  all_.Add(duration_ns, forced);
+  by_reason_[reason].Add(duration_ns, forced);
+}
+
+std::string PauseWatchdog::StatsJson() {
+  std::unique_lock<std::mutex> lock(lock_);
+  std::string json;
+  all_.AppendJson(&json);
+  // Splice the reasons into the overall object
+  json.pop_back();
+  json.append(",\"byReason\":{");
+  bool first = true;
+  for (const auto& reason : by_reason_) {
+    if (!first)
+      json.push_back(',');
+    AppendJsonString(&json, reason.first.data(), reason.first.size());
+    json.push_back(':');
+    reason.second.AppendJson(&json);
+    first = false;
+  }
+  json.append("}}");
+  return json;
+}
+
+}  // namespace inspector
@@ -0,0 +1,127 @@
+/*
+*    Copyright Node.js contributors. All rights reserved.
+*
+*    Permission is hereby granted, free of charge, to any person obtaining a copy
+*    of this software and associated documentation files (the "Software"), to
+*    deal in the Software without restriction, including without limitation the
+*    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+*    sell copies of the Software, and to permit persons to whom the Software is
+*    furnished to do so, subject to the following conditions:
+*
+*    The above copyright notice and this permission notice shall be included in
+*    all copies or substantial portions of the Software.
+*
+*    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+*    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+*    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+*    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+*    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+*    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+*    IN THE SOFTWARE.
+*/
+
+#ifndef SRC_INSPECTOR_WATCHDOG_H_
+#define SRC_INSPECTOR_WATCHDOG_H_
+
+#include "v8.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace inspector {
+
+// Notices the isolate thread running JS for longer than a threshold and
+// records where it is. The isolate marks entering and leaving JS through
+// V8's call callbacks. The IO thread calls Check() periodically and
+// interrupts the isolate when the current run is too long. The interrupt
+// captures a stack trace into a ring buffer.
+class SlowHandlerWatchdog {
+ public:
+  SlowHandlerWatchdog();
+  ~SlowHandlerWatchdog();
+
+  // Main thread only. A threshold of zero disables the watchdog.
+  void Enable(v8::Isolate* isolate, int threshold_ms, int max_frames,
+              size_t max_samples);
+  void Disable();
+
+  // How often the IO thread should call Check(), or zero if disabled.
+  int check_interval_ms() const;
+  // IO thread
+  void Check();
+  // Main thread. Time between the two, such as a debugger pause, does not
+  // count as running JS.
+  void Suspend();
+  void Resume();
+
+  // The recorded samples as a JSON array, oldest first. Thread-safe.
+  std::string SamplesJson();
+
+ private:
+  struct Sample {
+    int64_t time_ms;
+    int64_t running_ms;
+    std::vector<std::string> frames;
+  };
+
+  static void BeforeCallEntered(v8::Isolate* isolate);
+  static void CallCompleted(v8::Isolate* isolate);
+  static void Interrupt(v8::Isolate* isolate, void* watchdog);
+  void TakeSample();
+
+  v8::Isolate* isolate_;
+  std::atomic<int> threshold_ms_;
+  // uv_hrtime() when the current run of JS started, or zero
+  std::atomic<uint64_t> running_since_;
+  // uv_hrtime() of the last interrupt requested by Check()
+  uint64_t last_interrupt_;
+  // Whether JS was running when Suspend() was called
+  bool suspended_run_;
+  int max_frames_;
+  size_t max_samples_;
+  std::mutex lock_;
+  std::deque<Sample> samples_;
+};
+
+// Accounts for the time the isolate spends paused in the debugger, and
+// holds the longest a pause may last before the agent resumes it. All
+// methods are thread-safe.
+class PauseWatchdog {
+ public:
+  PauseWatchdog();
+
+  // Zero means pauses may last forever.
+  void set_max_pause_ms(int max_pause_ms) { max_pause_ms_ = max_pause_ms; }
+  int max_pause_ms() const { return max_pause_ms_; }
+
+  void Record(const std::string& reason, uint64_t duration_ns, bool forced);
+  // Count, total and longest pause, overall and by reason, as JSON
+  std::string StatsJson();
+
+ private:
+  struct Stats {
+    Stats() : count(0), forced(0), total_ns(0), max_ns(0) { }
+    void Add(uint64_t duration_ns, bool was_forced);
+    void AppendJson(std::string* json) const;
+    uint64_t count;
+    uint64_t forced;
+    uint64_t total_ns;
+    uint64_t max_ns;
+  };
+
+  std::atomic<int> max_pause_ms_;
+  std::mutex lock_;
+  Stats all_;
+  std::map<std::string, Stats> by_reason_;
+};
+
+}  // namespace inspector
+
+#endif  // SRC_INSPECTOR_WATCHDOG_H_